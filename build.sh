@@ -2,5 +2,5 @@
 
 set -xe
 
-cc -Wall -Wextra -o voronoi-ppm src/main_ppm.c
+cc -Wall -Wextra -o voronoi-ppm src/main_ppm.c -lm -lpthread
 cc -Wall -Wextra -o voronoi-opengl src/main_opengl.c -lglfw -lGL -lm
@@ -3,10 +3,9 @@
 
 precision mediump float;
 
-uniform vec2 resolution;
-
 in vec4 color;
 in vec2 seed;
+in float weight;
 out vec4 out_color;
 
 #define SEED_MARKER_RADIUS 5
@@ -17,7 +16,7 @@ void main(void) {
         gl_FragDepth = 0;
         out_color = SEED_MARKER_COLOR;
     } else {
-        gl_FragDepth = length(gl_FragCoord.xy - seed)/length(resolution);
+        gl_FragDepth = metric_depth(gl_FragCoord.xy - seed, weight);
         out_color = color;
     }
 }
@@ -0,0 +1,9 @@
+// Nothing but the color, the depth comes from the vertices of the cone.
+#version 330
+
+in vec4 color;
+out vec4 out_color;
+
+void main(void) {
+    out_color = color;
+}
@@ -0,0 +1,49 @@
+// Cone of one seed as a triangle fan, the apex sits on the seed and the rim
+// reaches past every corner of the bounds of its cell. Every vertex carries
+// its distance to the seed as depth, so the depth test keeps the closest seed
+// without writing gl_FragDepth and hidden fragments are rejected before
+// shading. Do glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, segments + 2, seeds_count).
+#version 330
+
+layout(location = 0) in vec2 seed_pos;
+layout(location = 1) in vec4 seed_color;
+layout(location = 2) in float seed_weight;
+layout(location = 3) in vec4 seed_bounds;
+
+uniform int segments;
+// Angle of the first vertex of the rim and how far out the vertices go so
+// the rim contains the whole ball of the reach and not just touches it
+uniform float rim_angle;
+uniform float rim_scale;
+
+out vec4 color;
+
+#define PI 3.14159265359
+
+float cone_depth(vec2 pos) {
+#if defined(METRIC_POWER)
+    // d² - w² is |pos|² plus a plane for every seed. |pos|² is the same for
+    // all of them, so the plane alone picks the closest seed and the cone
+    // is flat. Shifted and scaled into [0, 1] for any pos and seed on screen.
+    float diagonal2 = dot(resolution, resolution);
+    float plane = dot(seed_pos, seed_pos) - 2.0*dot(pos, seed_pos) - seed_weight*seed_weight;
+    return (plane + diagonal2 + max_weight*max_weight)/(2.0*diagonal2 + max_weight*max_weight);
+#else
+    return metric_depth(pos - seed_pos, seed_weight);
+#endif
+}
+
+void main(void)
+{
+    vec2 pos = seed_pos;
+    if (gl_VertexID > 0) {
+        // The farthest corner of the bounds, plus a pixel for rounding
+        vec2 corner = max(abs(seed_bounds.xy - seed_pos), abs(seed_bounds.zw - seed_pos));
+        float reach = metric_norm(corner) + 1.0;
+        float angle = rim_angle + 2.0*PI*float((gl_VertexID - 1)%segments)/float(segments);
+        vec2 dir = vec2(cos(angle), sin(angle));
+        pos += dir/metric_norm(dir)*reach*rim_scale;
+    }
+    gl_Position = vec4(pos/resolution*2.0 - 1.0, cone_depth(pos)*2.0 - 1.0, 1.0);
+    color = seed_color;
+}
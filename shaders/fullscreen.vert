@@ -0,0 +1,11 @@
+// Full screen triangle strip quad without any vertex attributes, just like
+// quad.vert. Do glDrawArrays(GL_TRIANGLE_STRIP, 0, 4).
+#version 330
+
+void main(void)
+{
+    vec2 uv;
+    uv.x = (gl_VertexID & 1);
+    uv.y = ((gl_VertexID >> 1) & 1);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,70 @@
+// Closest seed of every pixel in one full screen pass, no instances and no
+// depth buffer. The host bins the seeds into square cells of cell_size
+// pixels every frame: cells holds where the seeds of every cell start in
+// seeds, row by row with one more entry at the end, and seeds holds
+// (x, y, weight, index) of every seed. Same search as seed_grid_nearest()
+// of voronoi-ppm, including the smallest index winning ties.
+#version 330
+
+uniform usamplerBuffer cells;
+uniform samplerBuffer seeds;
+uniform samplerBuffer colors;
+uniform int cell_size;
+uniform ivec2 grid_size;
+
+out vec4 out_color;
+
+#define SEED_MARKER_RADIUS 5
+#define SEED_MARKER_COLOR vec4(.1, .1, .1, 1)
+
+int best = -1;
+float best_depth = 0;
+bool marker = false;
+
+void scan_cell(ivec2 g, vec2 p) {
+    if (any(lessThan(g, ivec2(0))) || any(greaterThanEqual(g, grid_size))) return;
+    int cell = g.y*grid_size.x + g.x;
+    int end = int(texelFetch(cells, cell + 1).r);
+    for (int k = int(texelFetch(cells, cell).r); k < end; ++k) {
+        vec4 s = texelFetch(seeds, k);
+        vec2 v = p - s.xy;
+        if (length(v) < SEED_MARKER_RADIUS) marker = true;
+        float d = metric_depth(v, s.z);
+        int i = int(s.w);
+        if (best < 0 || d < best_depth || (d == best_depth && i < best)) {
+            best = i;
+            best_depth = d;
+        }
+    }
+}
+
+void main(void) {
+    vec2 p = gl_FragCoord.xy;
+    ivec2 c = ivec2(p)/cell_size;
+
+    int max_ring = max(grid_size.x, grid_size.y);
+    for (int r = 0; r < max_ring; ++r) {
+        if (r == 0) {
+            scan_cell(c, p);
+        } else {
+            for (int gx = c.x - r; gx <= c.x + r; ++gx) {
+                scan_cell(ivec2(gx, c.y - r), p);
+                scan_cell(ivec2(gx, c.y + r), p);
+            }
+            for (int gy = c.y - r + 1; gy < c.y + r; ++gy) {
+                scan_cell(ivec2(c.x - r, gy), p);
+                scan_cell(ivec2(c.x + r, gy), p);
+            }
+        }
+
+        // Anything we have not looked at yet is at least this far away along
+        // one of the axes, and at best has the largest weight. It can not put
+        // its marker here either once that is past the marker radius.
+        vec2 before = p - vec2(c - r)*cell_size;
+        vec2 after = vec2(c + r + 1)*cell_size - p;
+        float reach = min(min(before.x, before.y), min(after.x, after.y));
+        if (best >= 0 && reach >= SEED_MARKER_RADIUS && metric_depth(vec2(reach, 0), max_weight) > best_depth) break;
+    }
+
+    out_color = marker ? SEED_MARKER_COLOR : texelFetch(colors, best);
+}
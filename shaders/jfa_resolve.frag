@@ -0,0 +1,29 @@
+// Turns the result of Jump Flooding into the colors of the seeds. colors
+// holds the color of seed i at (i%width, i/width).
+#version 330
+
+uniform sampler2D seeds;
+uniform sampler2D colors;
+
+out vec4 out_color;
+
+#define SEED_MARKER_RADIUS 5
+#define SEED_MARKER_COLOR vec4(.1, .1, .1, 1)
+#define BACKGROUND_COLOR vec4(.25, 0, 0, 1)
+
+void main(void) {
+    vec4 s = texelFetch(seeds, ivec2(gl_FragCoord.xy), 0);
+    if (s.w < 0) {
+        out_color = BACKGROUND_COLOR;
+        return;
+    }
+    // Only the marker of the pixel's own seed, markers do not overlap other
+    // cells like they do with the depth buffer
+    if (length(gl_FragCoord.xy - s.xy) < SEED_MARKER_RADIUS) {
+        out_color = SEED_MARKER_COLOR;
+        return;
+    }
+    int i = int(s.w);
+    int width = textureSize(colors, 0).x;
+    out_color = texelFetch(colors, ivec2(i%width, i/width), 0);
+}
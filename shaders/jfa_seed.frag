@@ -0,0 +1,10 @@
+// Texels of the Jump Flooding textures are the (x, y, weight, index) of the
+// closest seed found so far, index is -1 for none yet.
+#version 330
+
+flat in vec4 seed;
+out vec4 out_seed;
+
+void main(void) {
+    out_seed = seed;
+}
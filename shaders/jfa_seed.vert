@@ -0,0 +1,17 @@
+// Splats every seed into the pixel it lies in as one instanced point.
+// Do glDrawArraysInstanced(GL_POINTS, 0, 1, seeds_count).
+#version 330
+
+layout(location = 0) in vec2 seed_pos;
+layout(location = 2) in float seed_weight;
+
+flat out vec4 seed;
+
+void main(void)
+{
+    // Seeds right on the right or top edge of the screen still land in the
+    // last column or row of pixels
+    vec2 pixel = min(floor(seed_pos), resolution - 1.0) + 0.5;
+    gl_Position = vec4(pixel/resolution*2.0 - 1.0, 0.0, 1.0);
+    seed = vec4(seed_pos, seed_weight, gl_InstanceID);
+}
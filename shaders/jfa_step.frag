@@ -0,0 +1,29 @@
+// One Jump Flooding pass: every pixel keeps the closest of the seeds it and
+// its 8 neighbours `step` pixels away know about.
+#version 330
+
+uniform sampler2D seeds;
+uniform int step;
+
+out vec4 out_seed;
+
+void main(void) {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(seeds, 0);
+    vec4 best = vec4(0, 0, 0, -1);
+    float best_depth = 0;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            ivec2 q = p + ivec2(dx, dy)*step;
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size))) continue;
+            vec4 s = texelFetch(seeds, q, 0);
+            if (s.w < 0) continue;
+            float d = metric_depth(gl_FragCoord.xy - s.xy, s.z);
+            if (best.w < 0 || d < best_depth || (d == best_depth && s.w < best.w)) {
+                best = s;
+                best_depth = d;
+            }
+        }
+    }
+    out_seed = best;
+}
@@ -0,0 +1,13 @@
+// Round seed markers, drawn before the cones so the depth test keeps them.
+#version 330
+
+in vec2 seed;
+out vec4 out_color;
+
+#define SEED_MARKER_RADIUS 5
+#define SEED_MARKER_COLOR vec4(.1, .1, .1, 1)
+
+void main(void) {
+    if (length(gl_FragCoord.xy - seed) >= SEED_MARKER_RADIUS) discard;
+    out_color = SEED_MARKER_COLOR;
+}
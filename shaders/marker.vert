@@ -0,0 +1,19 @@
+// Square around the marker of one seed, in front of every cone.
+// Do glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, seeds_count).
+#version 330
+
+layout(location = 0) in vec2 seed_pos;
+
+out vec2 seed;
+
+#define SEED_MARKER_RADIUS 5
+
+void main(void)
+{
+    vec2 uv;
+    uv.x = (gl_VertexID & 1);
+    uv.y = ((gl_VertexID >> 1) & 1);
+    vec2 pos = seed_pos + (uv*2.0 - 1.0)*SEED_MARKER_RADIUS;
+    gl_Position = vec4(pos/resolution*2.0 - 1.0, -1.0, 1.0);
+    seed = seed_pos;
+}
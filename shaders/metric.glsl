@@ -0,0 +1,40 @@
+// Distances shared by the shaders. The host inserts this file right after
+// their #version line, behind one METRIC_* define picking the variant,
+// Euclidean is the default.
+
+uniform vec2 resolution;
+// Weights of the power and additive metrics are at most this
+uniform float max_weight;
+
+#if defined(METRIC_MINKOWSKI)
+float minkowski_length(vec2 v) {
+    vec2 a = pow(abs(v), vec2(MINKOWSKI_P));
+    return pow(a.x + a.y, 1.0/float(MINKOWSKI_P));
+}
+#endif
+
+// Length of v in the norm of the metric, the weighted metrics are Euclidean
+float metric_norm(vec2 v) {
+#if defined(METRIC_MANHATTAN)
+    return abs(v.x) + abs(v.y);
+#elif defined(METRIC_CHEBYSHEV)
+    return max(abs(v.x), abs(v.y));
+#elif defined(METRIC_MINKOWSKI)
+    return minkowski_length(v);
+#else
+    return length(v);
+#endif
+}
+
+// Distance v away from a seed of the given weight scaled into [0, 1]. The
+// weighted ones are shifted by the largest weight so they never go below 0.
+float metric_depth(vec2 v, float weight) {
+#if defined(METRIC_POWER)
+    float shift = max_weight*max_weight;
+    return (dot(v, v) - weight*weight + shift)/(dot(resolution, resolution) + shift);
+#elif defined(METRIC_ADDITIVE)
+    return (length(v) - weight + max_weight)/(length(resolution) + max_weight);
+#else
+    return metric_norm(v)/metric_norm(resolution);
+#endif
+}
@@ -1,23 +1,32 @@
-// Single triangle strip quad generated entirely on the vertex shader.
-// Simply do glDrawArrays(GL_TRIANGLE_STRIP, 0, 4) and the shader
-// generates 4 points from gl_VertexID. No Vertex Attributes are
-// required.
+// Triangle strip quad over the bounds of the cell of one seed generated
+// entirely on the vertex shader from gl_VertexID. Simply do
+// glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, seeds_count).
 #version 330
 
 precision mediump float;
 
 layout(location = 0) in vec2 seed_pos;
 layout(location = 1) in vec4 seed_color;
+layout(location = 2) in float seed_weight;
+layout(location = 3) in vec4 seed_bounds;
 
 out vec2 seed;
 out vec4 color;
+out float weight;
+
+#define SEED_MARKER_RADIUS 5
 
 void main(void)
 {
     vec2 uv;
     uv.x = (gl_VertexID & 1);
     uv.y = ((gl_VertexID >> 1) & 1);
-    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+    // The marker may stick out of a small cell, and a pixel more for rounding
+    vec2 lo = min(seed_bounds.xy, seed_pos - SEED_MARKER_RADIUS) - 1.0;
+    vec2 hi = max(seed_bounds.zw, seed_pos + SEED_MARKER_RADIUS) + 1.0;
+    vec2 pos = mix(lo, hi, uv);
+    gl_Position = vec4(pos/resolution*2.0 - 1.0, 0.0, 1.0);
     seed  = seed_pos;
     color = seed_color;
+    weight = seed_weight;
 }
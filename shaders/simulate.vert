@@ -0,0 +1,23 @@
+// One step of the motion of every seed, the same arithmetic as
+// move_seeds() on the CPU. Nothing gets drawn, the next position and
+// velocity are captured with transform feedback. Do
+// glDrawArrays(GL_POINTS, 0, seeds_count) with GL_RASTERIZER_DISCARD.
+#version 330
+
+uniform vec2 resolution;
+uniform float delta_time;
+
+layout(location = 0) in vec2 seed_pos;
+layout(location = 1) in vec2 seed_velocity;
+
+out vec2 next_pos;
+out vec2 next_velocity;
+
+void main(void)
+{
+    // Bounce off the edges of the screen by staying in place this step
+    vec2 pos = seed_pos + seed_velocity*delta_time;
+    bvec2 inside = bvec2(0 <= pos.x && pos.x <= resolution.x, 0 <= pos.y && pos.y <= resolution.y);
+    next_pos = mix(seed_pos, pos, inside);
+    next_velocity = mix(-seed_velocity, seed_velocity, inside);
+}
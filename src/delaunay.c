@@ -0,0 +1,674 @@
+// Incremental Delaunay triangulation of the seeds that survives seeds being
+// inserted, deleted and moved. Voronoi neighbours of a seed and the bounding
+// box of its cell come straight out of the triangles around it.
+//
+// Everything is kept in flat arrays. Triangle t is the half-edges 3t, 3t + 1
+// and 3t + 2 in counter-clockwise order. Half-edge e starts at vertex
+// origins[e] and twins[e] is the same edge in the neighbouring triangle
+// going the other way. The first DELAUNAY_SUPER_VERTICES vertices form a
+// triangle far around the screen, so every seed is strictly inside of the
+// triangulation and seed i is vertex i + DELAUNAY_SUPER_VERTICES.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DELAUNAY_NIL UINT32_MAX
+#define DELAUNAY_SUPER_VERTICES 3
+// Relative error allowed in delaunay_incircle() before an edge is flipped,
+// keeps the rounding errors of nearly cocircular points from flipping the
+// same edge back and forth
+#define DELAUNAY_INCIRCLE_EPSILON 1e-10
+
+#define delaunay_da_append(da, item)                                                 \
+    do {                                                                             \
+        if ((da)->count >= (da)->capacity) {                                         \
+            (da)->capacity = (da)->capacity == 0 ? 256 : (da)->capacity*2;           \
+            (da)->items = realloc((da)->items, (da)->capacity*sizeof(*(da)->items)); \
+            if ((da)->items == NULL) {                                               \
+                fprintf(stderr, "ERROR: could not allocate memory for Delaunay\n");  \
+                exit(1);                                                             \
+            }                                                                        \
+        }                                                                            \
+        (da)->items[(da)->count++] = (item);                                         \
+    } while (0)
+
+typedef struct {
+    double x, y;
+    // Some half-edge going out of the vertex, DELAUNAY_NIL while the vertex
+    // is not in the triangulation: deleted, or right on top of another one
+    uint32_t edge;
+} Delaunay_Vertex;
+
+typedef struct {
+    Delaunay_Vertex *items;
+    size_t count;
+    size_t capacity;
+} Delaunay_Vertices;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Delaunay_Indices;
+
+typedef struct {
+    float x0, y0, x1, y1;
+} Delaunay_Rect;
+
+// Voronoi edge between seeds a and b clipped to the screen
+typedef struct {
+    uint32_t a, b;
+    float x0, y0, x1, y1;
+} Delaunay_Edge;
+
+typedef struct {
+    // 3 per triangle, origins[3t] is DELAUNAY_NIL for free triangles
+    Delaunay_Indices origins;
+    Delaunay_Indices twins;
+    Delaunay_Indices free_triangles;
+    Delaunay_Vertices vertices;
+    // Point location starts walking from here
+    uint32_t last_triangle;
+    uint32_t random_state;
+    float width, height;
+
+    // Scratch
+    Delaunay_Indices flip_stack;
+    Delaunay_Indices polygon;
+    Delaunay_Indices polygon_twins;
+} Delaunay;
+
+static inline uint32_t delaunay_next(uint32_t e)
+{
+    return e%3 == 2 ? e - 2 : e + 1;
+}
+
+static inline uint32_t delaunay_prev(uint32_t e)
+{
+    return e%3 == 0 ? e + 2 : e - 1;
+}
+
+static inline bool delaunay_is_super(uint32_t v)
+{
+    return v < DELAUNAY_SUPER_VERTICES;
+}
+
+// > 0 when a, b, c go counter-clockwise
+double delaunay_orient(const Delaunay *dt, uint32_t a, uint32_t b, uint32_t c)
+{
+    const Delaunay_Vertex *va = &dt->vertices.items[a];
+    const Delaunay_Vertex *vb = &dt->vertices.items[b];
+    const Delaunay_Vertex *vc = &dt->vertices.items[c];
+    return (vb->x - va->x)*(vc->y - va->y) - (vb->y - va->y)*(vc->x - va->x);
+}
+
+// Whether d is clearly inside of the circumcircle of the counter-clockwise
+// triangle a, b, c
+bool delaunay_incircle(const Delaunay *dt, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    const Delaunay_Vertex *vd = &dt->vertices.items[d];
+    double adx = dt->vertices.items[a].x - vd->x, ady = dt->vertices.items[a].y - vd->y;
+    double bdx = dt->vertices.items[b].x - vd->x, bdy = dt->vertices.items[b].y - vd->y;
+    double cdx = dt->vertices.items[c].x - vd->x, cdy = dt->vertices.items[c].y - vd->y;
+    double alift = adx*adx + ady*ady;
+    double blift = bdx*bdx + bdy*bdy;
+    double clift = cdx*cdx + cdy*cdy;
+    double det = alift*(bdx*cdy - cdx*bdy) + blift*(cdx*ady - adx*cdy) + clift*(adx*bdy - bdx*ady);
+    double permanent = alift*(fabs(bdx*cdy) + fabs(cdx*bdy))
+                     + blift*(fabs(cdx*ady) + fabs(adx*cdy))
+                     + clift*(fabs(adx*bdy) + fabs(bdx*ady));
+    return det > DELAUNAY_INCIRCLE_EPSILON*permanent;
+}
+
+// Whether the edge of half-edge e has to be flipped. Always tested from the
+// lower half-edge of the pair so both sides agree near the epsilon
+bool delaunay_edge_illegal(const Delaunay *dt, uint32_t e)
+{
+    uint32_t f = dt->twins.items[e];
+    if (f == DELAUNAY_NIL) return false;
+    if (f < e) {
+        uint32_t tmp = e;
+        e = f;
+        f = tmp;
+    }
+    return delaunay_incircle(dt,
+                             dt->origins.items[e],
+                             dt->origins.items[delaunay_next(e)],
+                             dt->origins.items[delaunay_prev(e)],
+                             dt->origins.items[delaunay_prev(f)]);
+}
+
+void delaunay_link(Delaunay *dt, uint32_t e, uint32_t f)
+{
+    dt->twins.items[e] = f;
+    if (f != DELAUNAY_NIL) dt->twins.items[f] = e;
+}
+
+void delaunay_set_triangle(Delaunay *dt, uint32_t t, uint32_t a, uint32_t b, uint32_t c)
+{
+    dt->origins.items[3*t + 0] = a;
+    dt->origins.items[3*t + 1] = b;
+    dt->origins.items[3*t + 2] = c;
+    dt->vertices.items[a].edge = 3*t + 0;
+    dt->vertices.items[b].edge = 3*t + 1;
+    dt->vertices.items[c].edge = 3*t + 2;
+    dt->last_triangle = t;
+}
+
+uint32_t delaunay_alloc_triangle(Delaunay *dt)
+{
+    if (dt->free_triangles.count > 0) {
+        return dt->free_triangles.items[--dt->free_triangles.count];
+    }
+    uint32_t t = dt->origins.count/3;
+    for (int k = 0; k < 3; ++k) {
+        delaunay_da_append(&dt->origins, DELAUNAY_NIL);
+        delaunay_da_append(&dt->twins, DELAUNAY_NIL);
+    }
+    return t;
+}
+
+void delaunay_free_triangle(Delaunay *dt, uint32_t t)
+{
+    dt->origins.items[3*t] = DELAUNAY_NIL;
+    delaunay_da_append(&dt->free_triangles, t);
+}
+
+bool delaunay_triangle_alive(const Delaunay *dt, uint32_t t)
+{
+    return t < dt->origins.count/3 && dt->origins.items[3*t] != DELAUNAY_NIL;
+}
+
+void delaunay_init(Delaunay *dt, float width, float height)
+{
+    memset(dt, 0, sizeof(*dt));
+    dt->width = width;
+    dt->height = height;
+    dt->random_state = 2463534242;
+
+    // Far enough that no point of the screen is closer to a super vertex
+    // than to any seed, so the Voronoi cells within the screen come out
+    // right even for the seeds on the convex hull
+    double cx = width/2.0, cy = height/2.0;
+    double m = 16.0*(width > height ? width : height) + 16.0;
+    Delaunay_Vertex super[DELAUNAY_SUPER_VERTICES] = {
+        {cx - 2*m, cy - m, DELAUNAY_NIL},
+        {cx + 2*m, cy - m, DELAUNAY_NIL},
+        {cx, cy + 2*m, DELAUNAY_NIL},
+    };
+    for (size_t i = 0; i < DELAUNAY_SUPER_VERTICES; ++i) {
+        delaunay_da_append(&dt->vertices, super[i]);
+    }
+
+    uint32_t t = delaunay_alloc_triangle(dt);
+    delaunay_set_triangle(dt, t, 0, 1, 2);
+}
+
+// Restores the empty circumcircle property starting from the edges on the
+// flip stack
+void delaunay_legalize(Delaunay *dt)
+{
+    while (dt->flip_stack.count > 0) {
+        uint32_t e = dt->flip_stack.items[--dt->flip_stack.count];
+        if (!delaunay_triangle_alive(dt, e/3)) continue;
+        uint32_t f = dt->twins.items[e];
+        if (f == DELAUNAY_NIL) continue;
+
+        // e is a->b in the triangle a, b, c, f is b->a in b, a, d
+        uint32_t a = dt->origins.items[e];
+        uint32_t b = dt->origins.items[delaunay_next(e)];
+        uint32_t c = dt->origins.items[delaunay_prev(e)];
+        uint32_t d = dt->origins.items[delaunay_prev(f)];
+        if (!delaunay_edge_illegal(dt, e)) continue;
+        if (delaunay_orient(dt, c, a, d) <= 0 || delaunay_orient(dt, d, b, c) <= 0) continue;
+
+        uint32_t bc = dt->twins.items[delaunay_next(e)];
+        uint32_t ca = dt->twins.items[delaunay_prev(e)];
+        uint32_t ad = dt->twins.items[delaunay_next(f)];
+        uint32_t db = dt->twins.items[delaunay_prev(f)];
+        uint32_t t = e/3, u = f/3;
+        delaunay_set_triangle(dt, t, c, a, d);
+        delaunay_set_triangle(dt, u, d, b, c);
+        delaunay_link(dt, 3*t + 0, ca);
+        delaunay_link(dt, 3*t + 1, ad);
+        delaunay_link(dt, 3*u + 0, db);
+        delaunay_link(dt, 3*u + 1, bc);
+        delaunay_link(dt, 3*t + 2, 3*u + 2);
+
+        delaunay_da_append(&dt->flip_stack, 3*t + 0);
+        delaunay_da_append(&dt->flip_stack, 3*t + 1);
+        delaunay_da_append(&dt->flip_stack, 3*u + 0);
+        delaunay_da_append(&dt->flip_stack, 3*u + 1);
+    }
+}
+
+// Walks from the last touched triangle towards p. Returns the triangle
+// that contains p, with p possibly on its boundary.
+uint32_t delaunay_locate(Delaunay *dt, uint32_t p)
+{
+    uint32_t t = dt->last_triangle;
+    if (!delaunay_triangle_alive(dt, t)) {
+        for (t = 0; !delaunay_triangle_alive(dt, t); ++t) {}
+    }
+
+    for (;;) {
+        // Random first edge, so walking around degenerate spots never loops
+        dt->random_state ^= dt->random_state << 13;
+        dt->random_state ^= dt->random_state >> 17;
+        dt->random_state ^= dt->random_state << 5;
+        uint32_t start = dt->random_state%3;
+        bool moved = false;
+        for (uint32_t k = 0; k < 3; ++k) {
+            uint32_t e = 3*t + (start + k)%3;
+            uint32_t a = dt->origins.items[e];
+            uint32_t b = dt->origins.items[delaunay_next(e)];
+            if (delaunay_orient(dt, a, b, p) < 0 && dt->twins.items[e] != DELAUNAY_NIL) {
+                t = dt->twins.items[e]/3;
+                moved = true;
+                break;
+            }
+        }
+        if (!moved) return t;
+    }
+}
+
+// Puts the vertex p into the triangulation. The triangle that contains it
+// (or the two sharing the edge it is on) is split and the edges around p are
+// flipped until all the circumcircles are empty again, which gives the same
+// triangles as carving out the Bowyer-Watson cavity while keeping the
+// structure valid whatever the rounding errors. Returns false if p lands
+// right on another vertex, then p stays out until it moves away.
+bool delaunay_insert_vertex(Delaunay *dt, uint32_t p)
+{
+    uint32_t t = delaunay_locate(dt, p);
+    const Delaunay_Vertex *vp = &dt->vertices.items[p];
+    uint32_t on_edge = DELAUNAY_NIL;
+    for (uint32_t k = 0; k < 3; ++k) {
+        uint32_t e = 3*t + k;
+        const Delaunay_Vertex *v = &dt->vertices.items[dt->origins.items[e]];
+        if (v->x == vp->x && v->y == vp->y) {
+            dt->vertices.items[p].edge = DELAUNAY_NIL;
+            return false;
+        }
+        if (delaunay_orient(dt, dt->origins.items[e], dt->origins.items[delaunay_next(e)], p) == 0) on_edge = e;
+    }
+
+    if (on_edge == DELAUNAY_NIL || dt->twins.items[on_edge] == DELAUNAY_NIL) {
+        // a, b, c -> a, b, p + b, c, p + c, a, p
+        uint32_t a = dt->origins.items[3*t + 0];
+        uint32_t b = dt->origins.items[3*t + 1];
+        uint32_t c = dt->origins.items[3*t + 2];
+        uint32_t ab = dt->twins.items[3*t + 0];
+        uint32_t bc = dt->twins.items[3*t + 1];
+        uint32_t ca = dt->twins.items[3*t + 2];
+        uint32_t t1 = delaunay_alloc_triangle(dt);
+        uint32_t t2 = delaunay_alloc_triangle(dt);
+        delaunay_set_triangle(dt, t, a, b, p);
+        delaunay_set_triangle(dt, t1, b, c, p);
+        delaunay_set_triangle(dt, t2, c, a, p);
+        delaunay_link(dt, 3*t + 0, ab);
+        delaunay_link(dt, 3*t1 + 0, bc);
+        delaunay_link(dt, 3*t2 + 0, ca);
+        delaunay_link(dt, 3*t + 1, 3*t1 + 2);
+        delaunay_link(dt, 3*t1 + 1, 3*t2 + 2);
+        delaunay_link(dt, 3*t2 + 1, 3*t + 2);
+        delaunay_da_append(&dt->flip_stack, 3*t + 0);
+        delaunay_da_append(&dt->flip_stack, 3*t1 + 0);
+        delaunay_da_append(&dt->flip_stack, 3*t2 + 0);
+    } else {
+        // p is on a->b of a, b, c and b, a, d:
+        // -> c, a, p + b, c, p + d, b, p + a, d, p
+        uint32_t e = on_edge;
+        uint32_t f = dt->twins.items[e];
+        uint32_t a = dt->origins.items[e];
+        uint32_t b = dt->origins.items[delaunay_next(e)];
+        uint32_t c = dt->origins.items[delaunay_prev(e)];
+        uint32_t d = dt->origins.items[delaunay_prev(f)];
+        uint32_t bc = dt->twins.items[delaunay_next(e)];
+        uint32_t ca = dt->twins.items[delaunay_prev(e)];
+        uint32_t ad = dt->twins.items[delaunay_next(f)];
+        uint32_t db = dt->twins.items[delaunay_prev(f)];
+        uint32_t u = f/3;
+        uint32_t t1 = delaunay_alloc_triangle(dt);
+        uint32_t u1 = delaunay_alloc_triangle(dt);
+        delaunay_set_triangle(dt, t, c, a, p);
+        delaunay_set_triangle(dt, t1, b, c, p);
+        delaunay_set_triangle(dt, u, d, b, p);
+        delaunay_set_triangle(dt, u1, a, d, p);
+        delaunay_link(dt, 3*t + 0, ca);
+        delaunay_link(dt, 3*t1 + 0, bc);
+        delaunay_link(dt, 3*u + 0, db);
+        delaunay_link(dt, 3*u1 + 0, ad);
+        delaunay_link(dt, 3*t + 1, 3*u1 + 2);
+        delaunay_link(dt, 3*t + 2, 3*t1 + 1);
+        delaunay_link(dt, 3*t1 + 2, 3*u + 1);
+        delaunay_link(dt, 3*u + 2, 3*u1 + 1);
+        delaunay_da_append(&dt->flip_stack, 3*t + 0);
+        delaunay_da_append(&dt->flip_stack, 3*t1 + 0);
+        delaunay_da_append(&dt->flip_stack, 3*u + 0);
+        delaunay_da_append(&dt->flip_stack, 3*u1 + 0);
+    }
+
+    delaunay_legalize(dt);
+    return true;
+}
+
+// Takes the vertex out and fills the hole by clipping ears whose
+// circumcircle has none of the other vertices of the hole in it, which is
+// exactly the Delaunay triangulation of the hole
+void delaunay_remove_vertex(Delaunay *dt, uint32_t v)
+{
+    uint32_t start = dt->vertices.items[v].edge;
+    if (start == DELAUNAY_NIL) return;
+
+    // Link of v counter-clockwise, with the twins on the outer side
+    dt->polygon.count = 0;
+    dt->polygon_twins.count = 0;
+    uint32_t e = start;
+    do {
+        delaunay_da_append(&dt->polygon, dt->origins.items[delaunay_next(e)]);
+        delaunay_da_append(&dt->polygon_twins, dt->twins.items[delaunay_next(e)]);
+        uint32_t next = dt->twins.items[delaunay_prev(e)];
+        delaunay_free_triangle(dt, e/3);
+        e = next;
+    } while (e != start);
+    dt->vertices.items[v].edge = DELAUNAY_NIL;
+
+    uint32_t *poly = dt->polygon.items;
+    uint32_t *twins = dt->polygon_twins.items;
+    size_t n = dt->polygon.count;
+    while (n > 3) {
+        size_t best = n;
+        bool best_delaunay = false;
+        for (size_t i = 0; i < n && !best_delaunay; ++i) {
+            uint32_t a = poly[i], b = poly[(i + 1)%n], c = poly[(i + 2)%n];
+            if (delaunay_orient(dt, a, b, c) <= 0) continue;
+            bool empty = true;
+            bool delaunay = true;
+            for (size_t j = 3; j < n; ++j) {
+                uint32_t w = poly[(i + j)%n];
+                if (delaunay_orient(dt, a, b, w) >= 0 && delaunay_orient(dt, b, c, w) >= 0 && delaunay_orient(dt, c, a, w) >= 0) {
+                    empty = false;
+                    break;
+                }
+                if (delaunay_incircle(dt, a, b, c, w)) delaunay = false;
+            }
+            if (!empty) continue;
+            if (best == n || delaunay) {
+                best = i;
+                best_delaunay = delaunay;
+            }
+        }
+        // A star shaped polygon always has an ear
+        assert(best < n);
+
+        size_t i = best, i1 = (best + 1)%n;
+        uint32_t t = delaunay_alloc_triangle(dt);
+        delaunay_set_triangle(dt, t, poly[i], poly[i1], poly[(best + 2)%n]);
+        delaunay_link(dt, 3*t + 0, twins[i]);
+        delaunay_link(dt, 3*t + 1, twins[i1]);
+        dt->twins.items[3*t + 2] = DELAUNAY_NIL;
+        delaunay_da_append(&dt->flip_stack, 3*t + 0);
+        delaunay_da_append(&dt->flip_stack, 3*t + 1);
+
+        // The ear is gone, its a->c edge is a side of the hole now
+        twins[i] = 3*t + 2;
+        for (size_t j = i1; j + 1 < n; ++j) {
+            poly[j] = poly[j + 1];
+            twins[j] = twins[j + 1];
+        }
+        n -= 1;
+    }
+
+    uint32_t t = delaunay_alloc_triangle(dt);
+    delaunay_set_triangle(dt, t, poly[0], poly[1], poly[2]);
+    delaunay_link(dt, 3*t + 0, twins[0]);
+    delaunay_link(dt, 3*t + 1, twins[1]);
+    delaunay_link(dt, 3*t + 2, twins[2]);
+    delaunay_da_append(&dt->flip_stack, 3*t + 0);
+    delaunay_da_append(&dt->flip_stack, 3*t + 1);
+    delaunay_da_append(&dt->flip_stack, 3*t + 2);
+
+    // Only does anything when rounding errors picked a wrong ear
+    delaunay_legalize(dt);
+}
+
+void delaunay_insert(Delaunay *dt, uint32_t seed, float x, float y)
+{
+    uint32_t v = seed + DELAUNAY_SUPER_VERTICES;
+    while (dt->vertices.count <= v) {
+        Delaunay_Vertex none = {0, 0, DELAUNAY_NIL};
+        delaunay_da_append(&dt->vertices, none);
+    }
+    assert(dt->vertices.items[v].edge == DELAUNAY_NIL);
+    dt->vertices.items[v].x = x;
+    dt->vertices.items[v].y = y;
+    delaunay_insert_vertex(dt, v);
+}
+
+void delaunay_delete(Delaunay *dt, uint32_t seed)
+{
+    delaunay_remove_vertex(dt, seed + DELAUNAY_SUPER_VERTICES);
+}
+
+// Small moves that keep every triangle around the seed counter-clockwise
+// only need the edges around it flipped. Anything else is a delete plus
+// an insert.
+void delaunay_move(Delaunay *dt, uint32_t seed, float x, float y)
+{
+    uint32_t v = seed + DELAUNAY_SUPER_VERTICES;
+    Delaunay_Vertex *vertex = &dt->vertices.items[v];
+    if (vertex->x == x && vertex->y == y) return;
+
+    uint32_t start = vertex->edge;
+    if (start == DELAUNAY_NIL) {
+        vertex->x = x;
+        vertex->y = y;
+        delaunay_insert_vertex(dt, v);
+        return;
+    }
+
+    double old_x = vertex->x, old_y = vertex->y;
+    vertex->x = x;
+    vertex->y = y;
+    bool valid = true;
+    uint32_t e = start;
+    do {
+        uint32_t w0 = dt->origins.items[delaunay_next(e)];
+        uint32_t w1 = dt->origins.items[delaunay_prev(e)];
+        if (delaunay_orient(dt, v, w0, w1) <= 0) {
+            valid = false;
+            break;
+        }
+        e = dt->twins.items[delaunay_prev(e)];
+    } while (e != start);
+
+    if (valid) {
+        e = start;
+        do {
+            delaunay_da_append(&dt->flip_stack, e);
+            delaunay_da_append(&dt->flip_stack, delaunay_next(e));
+            e = dt->twins.items[delaunay_prev(e)];
+        } while (e != start);
+        delaunay_legalize(dt);
+    } else {
+        vertex->x = old_x;
+        vertex->y = old_y;
+        delaunay_remove_vertex(dt, v);
+        vertex = &dt->vertices.items[v];
+        vertex->x = x;
+        vertex->y = y;
+        delaunay_insert_vertex(dt, v);
+    }
+}
+
+// Circumcenter of the triangle of half-edge e, which is a vertex of the
+// Voronoi diagram
+void delaunay_circumcenter(const Delaunay *dt, uint32_t e, double *ux, double *uy)
+{
+    uint32_t t = e - e%3;
+    const Delaunay_Vertex *a = &dt->vertices.items[dt->origins.items[t]];
+    const Delaunay_Vertex *b = &dt->vertices.items[dt->origins.items[t + 1]];
+    const Delaunay_Vertex *c = &dt->vertices.items[dt->origins.items[t + 2]];
+    double d = 2*(a->x*(b->y - c->y) + b->x*(c->y - a->y) + c->x*(a->y - b->y));
+    double a2 = a->x*a->x + a->y*a->y;
+    double b2 = b->x*b->x + b->y*b->y;
+    double c2 = c->x*c->x + c->y*c->y;
+    *ux = (a2*(b->y - c->y) + b2*(c->y - a->y) + c2*(a->y - b->y))/d;
+    *uy = (a2*(c->x - b->x) + b2*(a->x - c->x) + c2*(b->x - a->x))/d;
+}
+
+// Voronoi edge dual to half-edge e, between the circumcenters of the two
+// triangles on its sides, clipped to the screen (Liang-Barsky). False when
+// nothing of positive length is left of it, or e is on the outer boundary.
+bool delaunay_voronoi_edge(const Delaunay *dt, uint32_t e, Delaunay_Edge *edge)
+{
+    uint32_t f = dt->twins.items[e];
+    if (f == DELAUNAY_NIL) return false;
+
+    double x0, y0, x1, y1;
+    delaunay_circumcenter(dt, e, &x0, &y0);
+    delaunay_circumcenter(dt, f, &x1, &y1);
+    double dx = x1 - x0, dy = y1 - y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {x0, dt->width - x0, y0, dt->height - y0};
+    double t0 = 0, t1 = 1;
+    for (size_t k = 0; k < 4; ++k) {
+        if (p[k] == 0) {
+            if (q[k] < 0) return false;
+        } else {
+            double t = q[k]/p[k];
+            if (p[k] < 0) {
+                if (t > t0) t0 = t;
+            } else {
+                if (t < t1) t1 = t;
+            }
+        }
+    }
+    if (t0 >= t1) return false;
+
+    edge->a = dt->origins.items[e] - DELAUNAY_SUPER_VERTICES;
+    edge->b = dt->origins.items[f] - DELAUNAY_SUPER_VERTICES;
+    edge->x0 = x0 + t0*dx;
+    edge->y0 = y0 + t0*dy;
+    edge->x1 = x0 + t1*dx;
+    edge->y1 = y0 + t1*dy;
+    return true;
+}
+
+// Seeds that share a Voronoi edge with the seed within the screen. Returns
+// how many there are, at most capacity of them are written out.
+size_t delaunay_neighbors(const Delaunay *dt, uint32_t seed, uint32_t *neighbors, size_t capacity)
+{
+    uint32_t start = dt->vertices.items[seed + DELAUNAY_SUPER_VERTICES].edge;
+    if (start == DELAUNAY_NIL) return 0;
+
+    size_t count = 0;
+    uint32_t e = start;
+    do {
+        uint32_t w = dt->origins.items[delaunay_next(e)];
+        Delaunay_Edge edge;
+        if (!delaunay_is_super(w) && delaunay_voronoi_edge(dt, e, &edge)) {
+            if (count < capacity) neighbors[count] = w - DELAUNAY_SUPER_VERTICES;
+            count += 1;
+        }
+        e = dt->twins.items[delaunay_prev(e)];
+    } while (e != start);
+    return count;
+}
+
+// Every Voronoi edge between two seeds that shows up on the screen, once.
+// Returns how many there are, at most capacity of them are written out.
+size_t delaunay_edges(const Delaunay *dt, Delaunay_Edge *edges, size_t capacity)
+{
+    size_t count = 0;
+    for (uint32_t e = 0; e < dt->origins.count; ++e) {
+        if (!delaunay_triangle_alive(dt, e/3)) continue;
+        uint32_t f = dt->twins.items[e];
+        // The other half-edge of the pair reports it
+        if (f == DELAUNAY_NIL || f < e) continue;
+        if (delaunay_is_super(dt->origins.items[e]) || delaunay_is_super(dt->origins.items[f])) continue;
+        Delaunay_Edge edge;
+        if (delaunay_voronoi_edge(dt, e, &edge)) {
+            if (count < capacity) edges[count] = edge;
+            count += 1;
+        }
+    }
+    return count;
+}
+
+// Bounding box of the part of the Voronoi cell of the seed within the
+// screen, from the circumcenters of the triangles around it. False for seeds
+// that are not in the triangulation.
+bool delaunay_cell_bbox(const Delaunay *dt, uint32_t seed, Delaunay_Rect *bbox)
+{
+    uint32_t start = dt->vertices.items[seed + DELAUNAY_SUPER_VERTICES].edge;
+    if (start == DELAUNAY_NIL) return false;
+
+    double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    uint32_t e = start;
+    do {
+        double ux, uy;
+        delaunay_circumcenter(dt, e, &ux, &uy);
+        if (ux < x0) x0 = ux;
+        if (uy < y0) y0 = uy;
+        if (ux > x1) x1 = ux;
+        if (uy > y1) y1 = uy;
+        e = dt->twins.items[delaunay_prev(e)];
+    } while (e != start);
+
+    bbox->x0 = x0 < 0 ? 0 : x0 > dt->width ? dt->width : x0;
+    bbox->y0 = y0 < 0 ? 0 : y0 > dt->height ? dt->height : y0;
+    bbox->x1 = x1 < 0 ? 0 : x1 > dt->width ? dt->width : x1;
+    bbox->y1 = y1 < 0 ? 0 : y1 > dt->height ? dt->height : y1;
+    return true;
+}
+
+// Slow consistency check of the whole structure, for debugging
+bool delaunay_check(const Delaunay *dt)
+{
+    size_t triangles_count = dt->origins.count/3;
+    for (uint32_t t = 0; t < triangles_count; ++t) {
+        if (!delaunay_triangle_alive(dt, t)) continue;
+        for (uint32_t e = 3*t; e < 3*t + 3; ++e) {
+            uint32_t a = dt->origins.items[e];
+            uint32_t b = dt->origins.items[delaunay_next(e)];
+            uint32_t c = dt->origins.items[delaunay_prev(e)];
+            if (e == 3*t && delaunay_orient(dt, a, b, c) <= 0) {
+                fprintf(stderr, "ERROR: Delaunay: triangle %u is not counter-clockwise\n", t);
+                return false;
+            }
+            uint32_t f = dt->twins.items[e];
+            if (f == DELAUNAY_NIL) {
+                if (!delaunay_is_super(a) || !delaunay_is_super(b)) {
+                    fprintf(stderr, "ERROR: Delaunay: half-edge %u has no twin\n", e);
+                    return false;
+                }
+                continue;
+            }
+            if (!delaunay_triangle_alive(dt, f/3) || dt->twins.items[f] != e ||
+                dt->origins.items[f] != b || dt->origins.items[delaunay_next(f)] != a) {
+                fprintf(stderr, "ERROR: Delaunay: half-edge %u and its twin %u do not match\n", e, f);
+                return false;
+            }
+            if (delaunay_edge_illegal(dt, e)) {
+                fprintf(stderr, "ERROR: Delaunay: edge %u is not locally Delaunay\n", e);
+                return false;
+            }
+        }
+    }
+    for (uint32_t v = 0; v < dt->vertices.count; ++v) {
+        uint32_t e = dt->vertices.items[v].edge;
+        if (e == DELAUNAY_NIL) continue;
+        if (!delaunay_triangle_alive(dt, e/3) || dt->origins.items[e] != v) {
+            fprintf(stderr, "ERROR: Delaunay: vertex %u points at a wrong half-edge\n", v);
+            return false;
+        }
+    }
+    return true;
+}
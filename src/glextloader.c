@@ -32,6 +32,17 @@ static PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = NULL;
 static PFNGLUNIFORM1IPROC glUniform1i = NULL;
 static PFNGLDRAWBUFFERSPROC glDrawBuffers = NULL;
 static PFNGLUNIFORM4FPROC glUniform4f = NULL;
+static PFNGLGENQUERIESPROC glGenQueries = NULL;
+static PFNGLBEGINQUERYPROC glBeginQuery = NULL;
+static PFNGLENDQUERYPROC glEndQuery = NULL;
+static PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = NULL;
+static PFNGLTEXBUFFERPROC glTexBuffer = NULL;
+static PFNGLUNIFORM2IPROC glUniform2i = NULL;
+static PFNGLTRANSFORMFEEDBACKVARYINGSPROC glTransformFeedbackVaryings = NULL;
+static PFNGLBINDBUFFERBASEPROC glBindBufferBase = NULL;
+static PFNGLBEGINTRANSFORMFEEDBACKPROC glBeginTransformFeedback = NULL;
+static PFNGLENDTRANSFORMFEEDBACKPROC glEndTransformFeedback = NULL;
+static PFNGLGETBUFFERSUBDATAPROC glGetBufferSubData = NULL;
 // TODO: there is something fishy with Windows gl.h header
 // Let's try to ship our own gl.h just like glext.h
 #ifdef _WIN32
@@ -74,6 +85,17 @@ static void load_gl_extensions(void)
     glUniform1i               = (PFNGLUNIFORM1IPROC) glfwGetProcAddress("glUniform1i");
     glDrawBuffers             = (PFNGLDRAWBUFFERSPROC) glfwGetProcAddress("glDrawBuffers");
     glUniform4f               = (PFNGLUNIFORM4FPROC) glfwGetProcAddress("glUniform4f");
+    glGenQueries              = (PFNGLGENQUERIESPROC) glfwGetProcAddress("glGenQueries");
+    glBeginQuery              = (PFNGLBEGINQUERYPROC) glfwGetProcAddress("glBeginQuery");
+    glEndQuery                = (PFNGLENDQUERYPROC) glfwGetProcAddress("glEndQuery");
+    glGetQueryObjectui64v     = (PFNGLGETQUERYOBJECTUI64VPROC) glfwGetProcAddress("glGetQueryObjectui64v");
+    glTexBuffer               = (PFNGLTEXBUFFERPROC) glfwGetProcAddress("glTexBuffer");
+    glUniform2i               = (PFNGLUNIFORM2IPROC) glfwGetProcAddress("glUniform2i");
+    glTransformFeedbackVaryings = (PFNGLTRANSFORMFEEDBACKVARYINGSPROC) glfwGetProcAddress("glTransformFeedbackVaryings");
+    glBindBufferBase          = (PFNGLBINDBUFFERBASEPROC) glfwGetProcAddress("glBindBufferBase");
+    glBeginTransformFeedback  = (PFNGLBEGINTRANSFORMFEEDBACKPROC) glfwGetProcAddress("glBeginTransformFeedback");
+    glEndTransformFeedback    = (PFNGLENDTRANSFORMFEEDBACKPROC) glfwGetProcAddress("glEndTransformFeedback");
+    glGetBufferSubData        = (PFNGLGETBUFFERSUBDATAPROC) glfwGetProcAddress("glGetBufferSubData");
 #ifdef _WIN32
     glActiveTexture           = (PFNGLACTIVETEXTUREPROC) glfwGetProcAddress("glActiveTexture");
 #endif // _WIN32
@@ -0,0 +1,299 @@
+// Nearest point queries on an implicit k-d tree.
+//
+// The tree is a complete binary tree kept in flat arrays. Internal node i
+// has the children 2i + 1 and 2i + 2, and the leaves are the last
+// leaves_count nodes. Leaf k holds the points k*count/leaves_count up to
+// (k + 1)*count/leaves_count of the build order, at most KD_LEAF_SIZE of
+// them, stored as separate arrays of x, y and index with the unused slots
+// at infinity. So a leaf is a couple of cache lines scanned without any
+// branches.
+//
+// Ties are broken towards the smallest index, just like a linear scan over
+// the points that keeps the first closest one.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KD_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define KD_LEAF_SIZE 8
+// Enough for the path to a leaf of any tree with 32-bit indices
+#define KD_MAX_DEPTH 64
+
+// Squared distance from (x, y) to the closest point of a leaf, the slot of
+// the first such point goes to *slot
+typedef double (*Kd_Leaf_Scan)(const double *xs, const double *ys, double x, double y, int *slot);
+
+typedef struct {
+    size_t count;
+    // Always a power of two, leaves_count - 1 internal nodes
+    size_t leaves_count;
+    double *splits;
+    // 0 splits by x, 1 by y
+    uint8_t *axes;
+    double *xs;
+    double *ys;
+    uint32_t *indices;
+    Kd_Leaf_Scan leaf_scan;
+    // Leaves the arrays have room for, and the scratch permutation of the
+    // build of as many points as they have slots
+    size_t leaves_capacity;
+    uint32_t *perm;
+} Kd_Tree;
+
+double kd_leaf_scan_scalar(const double *xs, const double *ys, double x, double y, int *slot)
+{
+    double best = INFINITY;
+    *slot = 0;
+    for (int i = 0; i < KD_LEAF_SIZE; ++i) {
+        double dx = xs[i] - x;
+        double dy = ys[i] - y;
+        double d = dx*dx + dy*dy;
+        if (d < best) {
+            best = d;
+            *slot = i;
+        }
+    }
+    return best;
+}
+
+#ifdef KD_SIMD_X86
+__attribute__((target("sse2")))
+double kd_leaf_scan_sse2(const double *xs, const double *ys, double x, double y, int *slot)
+{
+    __m128d qx = _mm_set1_pd(x);
+    __m128d qy = _mm_set1_pd(y);
+    __m128d d[KD_LEAF_SIZE/2];
+    __m128d m = _mm_set1_pd(INFINITY);
+    for (int i = 0; i < KD_LEAF_SIZE/2; ++i) {
+        __m128d dx = _mm_sub_pd(_mm_load_pd(&xs[2*i]), qx);
+        __m128d dy = _mm_sub_pd(_mm_load_pd(&ys[2*i]), qy);
+        d[i] = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        m = _mm_min_pd(m, d[i]);
+    }
+    m = _mm_min_pd(m, _mm_shuffle_pd(m, m, 1));
+    int mask = 0;
+    for (int i = 0; i < KD_LEAF_SIZE/2; ++i) {
+        mask |= _mm_movemask_pd(_mm_cmpeq_pd(d[i], m)) << 2*i;
+    }
+    *slot = __builtin_ctz(mask);
+    return _mm_cvtsd_f64(m);
+}
+
+__attribute__((target("avx2")))
+double kd_leaf_scan_avx2(const double *xs, const double *ys, double x, double y, int *slot)
+{
+    __m256d qx = _mm256_set1_pd(x);
+    __m256d qy = _mm256_set1_pd(y);
+    __m256d dx0 = _mm256_sub_pd(_mm256_load_pd(&xs[0]), qx);
+    __m256d dy0 = _mm256_sub_pd(_mm256_load_pd(&ys[0]), qy);
+    __m256d dx1 = _mm256_sub_pd(_mm256_load_pd(&xs[4]), qx);
+    __m256d dy1 = _mm256_sub_pd(_mm256_load_pd(&ys[4]), qy);
+    __m256d d0 = _mm256_add_pd(_mm256_mul_pd(dx0, dx0), _mm256_mul_pd(dy0, dy0));
+    __m256d d1 = _mm256_add_pd(_mm256_mul_pd(dx1, dx1), _mm256_mul_pd(dy1, dy1));
+    __m256d m = _mm256_min_pd(d0, d1);
+    m = _mm256_min_pd(m, _mm256_permute2f128_pd(m, m, 1));
+    m = _mm256_min_pd(m, _mm256_shuffle_pd(m, m, 5));
+    int mask = _mm256_movemask_pd(_mm256_cmp_pd(d0, m, _CMP_EQ_OQ))
+             | _mm256_movemask_pd(_mm256_cmp_pd(d1, m, _CMP_EQ_OQ)) << 4;
+    *slot = __builtin_ctz(mask);
+    return _mm256_cvtsd_f64(m);
+}
+
+__attribute__((target("avx512f")))
+double kd_leaf_scan_avx512(const double *xs, const double *ys, double x, double y, int *slot)
+{
+    __m512d dx = _mm512_sub_pd(_mm512_load_pd(xs), _mm512_set1_pd(x));
+    __m512d dy = _mm512_sub_pd(_mm512_load_pd(ys), _mm512_set1_pd(y));
+    __m512d d = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+    double m = _mm512_reduce_min_pd(d);
+    *slot = __builtin_ctz(_mm512_cmp_pd_mask(d, _mm512_set1_pd(m), _CMP_EQ_OQ));
+    return m;
+}
+#endif // KD_SIMD_X86
+
+// Moves the k-th smallest key of perm[lo..hi) to perm[k], with nothing
+// bigger before it and nothing smaller after it
+void kd_select(uint32_t *perm, const double *keys, size_t lo, size_t hi, size_t k)
+{
+    while (hi - lo > 1) {
+        // Hoare partition around the middle key, it leaves
+        // perm[lo..j] <= pivot <= perm[j+1..hi) with lo <= j < hi - 1
+        double pivot = keys[perm[lo + (hi - lo - 1)/2]];
+        int64_t i = (int64_t)lo - 1, j = hi;
+        for (;;) {
+            do i += 1; while (keys[perm[i]] < pivot);
+            do j -= 1; while (keys[perm[j]] > pivot);
+            if (i >= j) break;
+            uint32_t t = perm[i];
+            perm[i] = perm[j];
+            perm[j] = t;
+        }
+        if (k <= (size_t)j) hi = j + 1;
+        else lo = j + 1;
+    }
+}
+
+void kd_build_node(Kd_Tree *kd, uint32_t *perm, const double *xs, const double *ys,
+                   size_t node, size_t leaf_lo, size_t leaf_hi)
+{
+    size_t lo = leaf_lo*kd->count/kd->leaves_count;
+    size_t hi = leaf_hi*kd->count/kd->leaves_count;
+
+    if (leaf_hi - leaf_lo == 1) {
+        // Increasing index order, so the first closest slot has the
+        // smallest index
+        for (size_t i = lo + 1; i < hi; ++i) {
+            uint32_t p = perm[i];
+            size_t j = i;
+            for (; j > lo && perm[j - 1] > p; --j) perm[j] = perm[j - 1];
+            perm[j] = p;
+        }
+        size_t base = leaf_lo*KD_LEAF_SIZE;
+        for (size_t i = 0; i < KD_LEAF_SIZE; ++i) {
+            if (lo + i < hi) {
+                kd->xs[base + i] = xs[perm[lo + i]];
+                kd->ys[base + i] = ys[perm[lo + i]];
+                kd->indices[base + i] = perm[lo + i];
+            } else {
+                kd->xs[base + i] = INFINITY;
+                kd->ys[base + i] = INFINITY;
+                kd->indices[base + i] = UINT32_MAX;
+            }
+        }
+        return;
+    }
+
+    // Split along the wider side of the bounding box
+    double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    for (size_t i = lo; i < hi; ++i) {
+        double x = xs[perm[i]], y = ys[perm[i]];
+        if (x < x0) x0 = x;
+        if (x > x1) x1 = x;
+        if (y < y0) y0 = y;
+        if (y > y1) y1 = y;
+    }
+    uint8_t axis = y1 - y0 > x1 - x0;
+    const double *keys = axis ? ys : xs;
+
+    size_t leaf_mid = leaf_lo + (leaf_hi - leaf_lo)/2;
+    size_t mid = leaf_mid*kd->count/kd->leaves_count;
+    kd_select(perm, keys, lo, hi, mid);
+    kd->axes[node] = axis;
+    kd->splits[node] = keys[perm[mid]];
+
+    kd_build_node(kd, perm, xs, ys, 2*node + 1, leaf_lo, leaf_mid);
+    kd_build_node(kd, perm, xs, ys, 2*node + 2, leaf_mid, leaf_hi);
+}
+
+void *kd_alloc(void *old, size_t size)
+{
+    // Nothing in there has to survive, no point in copying it like realloc()
+    free(old);
+    void *data = aligned_alloc(64, (size + 63)/64*64);
+    if (data == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes for the k-d tree\n", size);
+        exit(1);
+    }
+    return data;
+}
+
+// Builds the tree over count > 0 points. A tree can be built again over
+// different points, the memory of the previous one is reused unless it
+// needs more leaves than before. The caller picks the leaf scan, one of the
+// kd_leaf_scan_* kernels the CPU supports.
+void kd_tree_build(Kd_Tree *kd, const double *xs, const double *ys, size_t count, Kd_Leaf_Scan leaf_scan)
+{
+    assert(count > 0 && count < UINT32_MAX);
+    kd->count = count;
+    kd->leaves_count = 1;
+    while (kd->leaves_count*KD_LEAF_SIZE < count) kd->leaves_count *= 2;
+
+    if (kd->leaves_count > kd->leaves_capacity) {
+        kd->leaves_capacity = kd->leaves_count;
+        size_t slots = kd->leaves_capacity*KD_LEAF_SIZE;
+        kd->splits = kd_alloc(kd->splits, kd->leaves_capacity*sizeof(*kd->splits));
+        kd->axes = kd_alloc(kd->axes, kd->leaves_capacity*sizeof(*kd->axes));
+        kd->xs = kd_alloc(kd->xs, slots*sizeof(*kd->xs));
+        kd->ys = kd_alloc(kd->ys, slots*sizeof(*kd->ys));
+        kd->indices = kd_alloc(kd->indices, slots*sizeof(*kd->indices));
+        kd->perm = kd_alloc(kd->perm, slots*sizeof(*kd->perm));
+    }
+
+    for (size_t i = 0; i < count; ++i) kd->perm[i] = i;
+    kd_build_node(kd, kd->perm, xs, ys, 0, 0, kd->leaves_count);
+    kd->leaf_scan = leaf_scan;
+}
+
+void kd_tree_free(Kd_Tree *kd)
+{
+    free(kd->splits);
+    free(kd->axes);
+    free(kd->xs);
+    free(kd->ys);
+    free(kd->indices);
+    free(kd->perm);
+    memset(kd, 0, sizeof(*kd));
+}
+
+// Index of the closest point to (x, y), the squared distance to it goes to
+// *sqr_distance
+uint32_t kd_tree_nearest(const Kd_Tree *kd, double x, double y, double *sqr_distance)
+{
+    // Far children skipped on the way down, with the squared distance to
+    // their splitting line
+    size_t stack_nodes[KD_MAX_DEPTH];
+    double stack_dists[KD_MAX_DEPTH];
+    size_t stack_count = 0;
+
+    size_t internal_count = kd->leaves_count - 1;
+    uint32_t best = UINT32_MAX;
+    double best_dist = INFINITY;
+    size_t node = 0;
+    for (;;) {
+        while (node < internal_count) {
+            double delta = (kd->axes[node] ? y : x) - kd->splits[node];
+            size_t right = delta >= 0;
+            stack_nodes[stack_count] = 2*node + 2 - right;
+            stack_dists[stack_count] = delta*delta;
+            stack_count += 1;
+            node = 2*node + 1 + right;
+        }
+
+        size_t base = (node - internal_count)*KD_LEAF_SIZE;
+        int slot;
+        double d = kd->leaf_scan(&kd->xs[base], &kd->ys[base], x, y, &slot);
+        uint32_t index = kd->indices[base + slot];
+        if (d < best_dist || (d == best_dist && index < best)) {
+            best = index;
+            best_dist = d;
+        }
+
+        // Equally far subtrees are still visited for the smaller index
+        do {
+            if (stack_count == 0) {
+                if (sqr_distance != NULL) *sqr_distance = best_dist;
+                return best;
+            }
+            stack_count -= 1;
+        } while (stack_dists[stack_count] > best_dist);
+        node = stack_nodes[stack_count];
+    }
+}
+
+// kd_tree_nearest() for count points, sqr_distances may be NULL
+void kd_tree_nearest_batch(const Kd_Tree *kd, const double *xs, const double *ys, size_t count,
+                           uint32_t *indices, double *sqr_distances)
+{
+    for (size_t i = 0; i < count; ++i) {
+        indices[i] = kd_tree_nearest(kd, xs[i], ys[i], sqr_distances != NULL ? &sqr_distances[i] : NULL);
+    }
+}
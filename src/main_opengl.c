@@ -12,13 +12,25 @@
 #include <GLFW/glfw3.h>
 
 #include "glextloader.c"
+#include "delaunay.c"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
 #define DEFAULT_SCREEN_WIDTH 1600
 #define DEFAULT_SCREEN_HEIGHT 900
-#define SEEDS_COUNT 20
+#define DEFAULT_SEEDS_COUNT 20
+#define BUFFERS_ALIGNMENT 64
+// Weights of the power and additive metrics, in pixels
+#define DEFAULT_MAX_WEIGHT 50
+
+// The p of the minkowski metric is baked into its shader variant
+#ifndef MINKOWSKI_P
+#define MINKOWSKI_P 3
+#endif
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
 
 #define UNIMPLEMENTED(message) \
     do { \
@@ -43,12 +55,133 @@ typedef struct {
 enum Attrib {
     ATTRIB_POS = 0,
     ATTRIB_COLOR,
+    ATTRIB_WEIGHT,
+    ATTRIB_BOUNDS,
     COUNT_ATTRIBS,
 };
 
-static Vector2 seed_positions[SEEDS_COUNT];
-static Vector4 seed_colors[SEEDS_COUNT];
-static Vector2 seed_velocities[SEEDS_COUNT];
+static int screen_width = DEFAULT_SCREEN_WIDTH;
+static int screen_height = DEFAULT_SCREEN_HEIGHT;
+static size_t seeds_count = DEFAULT_SEEDS_COUNT;
+
+// All of these are carved out of a single allocation, see alloc_buffers()
+static Vector2 *seed_positions;
+static Vector4 *seed_colors;
+// Only the power and additive metrics look at them, zero otherwise
+static float *seed_weights;
+// Conservative bounding boxes of the cells as (x0, y0, x1, y1), see update_seed_bounds()
+static Vector4 *seed_bounds;
+static Vector2 *seed_velocities;
+static uint32_t *frame_pixels;
+
+typedef enum {
+    METRIC_EUCLIDEAN = 0,
+    METRIC_MANHATTAN,
+    METRIC_CHEBYSHEV,
+    METRIC_MINKOWSKI,
+    METRIC_POWER,
+    METRIC_ADDITIVE,
+    COUNT_METRICS,
+} Metric;
+
+static const char *metric_names[COUNT_METRICS] = {
+    [METRIC_EUCLIDEAN] = "euclidean",
+    [METRIC_MANHATTAN] = "manhattan",
+    [METRIC_CHEBYSHEV] = "chebyshev",
+    [METRIC_MINKOWSKI] = "minkowski",
+    [METRIC_POWER]     = "power",
+    [METRIC_ADDITIVE]  = "additive",
+};
+
+// Picks the variant of shaders/metric.glsl
+static const char *metric_defines[COUNT_METRICS] = {
+    [METRIC_EUCLIDEAN] = "#define METRIC_EUCLIDEAN\n",
+    [METRIC_MANHATTAN] = "#define METRIC_MANHATTAN\n",
+    [METRIC_CHEBYSHEV] = "#define METRIC_CHEBYSHEV\n",
+    [METRIC_MINKOWSKI] = "#define METRIC_MINKOWSKI\n#define MINKOWSKI_P " STRINGIFY(MINKOWSKI_P) "\n",
+    [METRIC_POWER]     = "#define METRIC_POWER\n",
+    [METRIC_ADDITIVE]  = "#define METRIC_ADDITIVE\n",
+};
+
+static Metric metric = METRIC_EUCLIDEAN;
+static int max_weight = DEFAULT_MAX_WEIGHT;
+
+typedef enum {
+    // One quad per seed over the bounds of its cell, the depth test keeps the closest
+    RENDERER_QUADS = 0,
+    // Jump Flooding between two framebuffers, cost independent of the seeds count
+    RENDERER_JFA,
+    // Cone mesh per seed, depth from the vertices so early depth test works
+    RENDERER_CONES,
+    // One full screen pass searching a uniform grid of the seeds
+    RENDERER_GRID,
+    COUNT_RENDERERS,
+} Renderer;
+
+static const char *renderer_names[COUNT_RENDERERS] = {
+    [RENDERER_QUADS] = "quads",
+    [RENDERER_JFA]   = "jfa",
+    [RENDERER_CONES] = "cones",
+    [RENDERER_GRID]  = "grid",
+};
+
+static Renderer renderer = RENDERER_QUADS;
+
+// Width of the texture with the colors of the seeds for the jfa renderer
+#define JFA_COLORS_WIDTH 1024
+
+static GLuint jfa_textures[2];
+static GLuint jfa_fbos[2];
+static GLuint jfa_colors_texture;
+static GLuint jfa_seed_program;
+static GLuint jfa_step_program;
+static GLuint jfa_resolve_program;
+static GLint jfa_u_step;
+static int jfa_first_step;
+
+// Segments of the rim of the round cones, the depth in between the vertices
+// of the rim is off by at most 1 - cos(pi/CONE_SEGMENTS) of the distance
+#ifndef CONE_SEGMENTS
+#define CONE_SEGMENTS 64
+#endif
+
+static GLuint cones_program;
+static GLuint markers_program;
+static int cone_segments;
+
+// Square cells of the grid renderer, rebuilt every frame, see render_grid()
+static int grid_cell_size;
+static int grid_cols;
+static int grid_rows;
+// Where the seeds of every cell start in grid_seeds, plus the end of the last one
+static uint32_t *grid_cells;
+// (x, y, weight, index) of the seeds, cell by cell
+static Vector4 *grid_seeds;
+static GLuint grid_cells_buffer;
+static GLuint grid_seeds_buffer;
+static GLuint grid_colors_buffer;
+static GLuint grid_textures[3];
+static GLuint grid_program;
+
+// Delaunay triangulation of seed_positions, follows the seeds every frame
+// when use_delaunay is set
+static Delaunay delaunay;
+static bool use_delaunay = false;
+static bool check_delaunay = false;
+
+// Moves the seeds with transform feedback between two pairs of buffers, the
+// positions reach the CPU only for the renderers that need them there
+static bool gpu_simulation = false;
+// Runs move_seeds() next to the GPU and compares them after every frame
+static bool check_simulation = false;
+static GLuint simulation_program;
+static GLint simulation_u_delta_time;
+static GLuint simulation_vaos[2];
+static GLuint simulation_positions[2];
+static GLuint simulation_velocities[2];
+static size_t simulation_current;
+static Vector2 *check_positions;
+static Vector2 *check_velocities;
 static GLuint vao;
 static GLuint vbos[COUNT_ATTRIBS];
 
@@ -141,7 +274,27 @@ bool compile_shader_source(const GLchar *source, GLenum shader_type, GLuint *sha
     return true;
 }
 
-bool compile_shader_file(const char *file_path, GLenum shader_type, GLuint *shader)
+// Inserts the prelude right after the #version line, which has to come
+// before anything else but comments
+char *insert_shader_prelude(char *source, const char *prelude)
+{
+    char *version = strstr(source, "#version");
+    if (version == NULL) return NULL;
+    char *rest = strchr(version, '\n');
+    if (rest == NULL) return NULL;
+    rest += 1;
+
+    size_t head_size = rest - source;
+    size_t prelude_size = strlen(prelude);
+    char *result = malloc(head_size + prelude_size + strlen(rest) + 1);
+    if (result == NULL) return NULL;
+    memcpy(result, source, head_size);
+    memcpy(result + head_size, prelude, prelude_size);
+    strcpy(result + head_size + prelude_size, rest);
+    return result;
+}
+
+bool compile_shader_file(const char *file_path, const char *prelude, GLenum shader_type, GLuint *shader)
 {
     char *source = slurp_file_into_malloced_cstr(file_path);
     if (source == NULL) {
@@ -149,6 +302,15 @@ bool compile_shader_file(const char *file_path, GLenum shader_type, GLuint *shad
         errno = 0;
         return false;
     }
+    if (prelude != NULL) {
+        char *full = insert_shader_prelude(source, prelude);
+        free(source);
+        if (full == NULL) {
+            fprintf(stderr, "ERROR: could not add the prelude to `%s`, it has no #version line\n", file_path);
+            return false;
+        }
+        source = full;
+    }
     bool ok = compile_shader_source(source, shader_type, shader);
     if (!ok) {
         fprintf(stderr, "ERROR: failed to compile `%s` shader file\n", file_path);
@@ -181,17 +343,38 @@ bool link_program(GLuint vert_shader, GLuint frag_shader, GLuint *program)
     return program;
 }
 
+// Both shaders get the distances of shaders/metric.glsl
 bool load_shader_program(const char *vertex_file_path,
                          const char *fragment_file_path,
                          GLuint *program)
 {
+    static char *prelude = NULL;
+    if (prelude == NULL) {
+        const char *metric_file_path = "shaders/metric.glsl";
+        char *metric_source = slurp_file_into_malloced_cstr(metric_file_path);
+        if (metric_source == NULL) {
+            fprintf(stderr, "ERROR: failed to read file `%s`: %s\n", metric_file_path, strerror(errno));
+            errno = 0;
+            return false;
+        }
+        const char *defines = metric_defines[metric];
+        prelude = malloc(strlen(defines) + strlen(metric_source) + 1);
+        if (prelude == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for the shader prelude\n");
+            exit(1);
+        }
+        strcpy(prelude, defines);
+        strcat(prelude, metric_source);
+        free(metric_source);
+    }
+
     GLuint vert = 0;
-    if (!compile_shader_file(vertex_file_path, GL_VERTEX_SHADER, &vert)) {
+    if (!compile_shader_file(vertex_file_path, prelude, GL_VERTEX_SHADER, &vert)) {
         return false;
     }
 
     GLuint frag = 0;
-    if (!compile_shader_file(fragment_file_path, GL_FRAGMENT_SHADER, &frag)) {
+    if (!compile_shader_file(fragment_file_path, prelude, GL_FRAGMENT_SHADER, &frag)) {
         return false;
     }
 
@@ -212,11 +395,44 @@ float lerpf(float a, float b, float t)
     return a + (b - a)*t;
 }
 
+size_t align_buffer_size(size_t size)
+{
+    return (size + BUFFERS_ALIGNMENT - 1)/BUFFERS_ALIGNMENT*BUFFERS_ALIGNMENT;
+}
+
+void alloc_buffers(void)
+{
+    size_t positions_size = align_buffer_size(seeds_count*sizeof(*seed_positions));
+    size_t colors_size = align_buffer_size(seeds_count*sizeof(*seed_colors));
+    size_t weights_size = align_buffer_size(seeds_count*sizeof(*seed_weights));
+    size_t bounds_size = align_buffer_size(seeds_count*sizeof(*seed_bounds));
+    size_t velocities_size = align_buffer_size(seeds_count*sizeof(*seed_velocities));
+    size_t frame_size = align_buffer_size((size_t)screen_width*screen_height*sizeof(*frame_pixels));
+
+    char *buffer = aligned_alloc(BUFFERS_ALIGNMENT, positions_size + colors_size + weights_size + bounds_size + velocities_size + frame_size);
+    if (buffer == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for %zu seeds and %dx%d frame\n",
+                seeds_count, screen_width, screen_height);
+        exit(1);
+    }
+    seed_positions = (Vector2*) buffer;
+    buffer += positions_size;
+    seed_colors = (Vector4*) buffer;
+    buffer += colors_size;
+    seed_weights = (float*) buffer;
+    buffer += weights_size;
+    seed_bounds = (Vector4*) buffer;
+    buffer += bounds_size;
+    seed_velocities = (Vector2*) buffer;
+    buffer += velocities_size;
+    frame_pixels = (uint32_t*) buffer;
+}
+
 void generate_random_seeds(void)
 {
-    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
-        seed_positions[i].x = rand_float()*DEFAULT_SCREEN_WIDTH;
-        seed_positions[i].y = rand_float()*DEFAULT_SCREEN_HEIGHT;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        seed_positions[i].x = rand_float()*screen_width;
+        seed_positions[i].y = rand_float()*screen_height;
         seed_colors[i].x = rand_float();
         seed_colors[i].y = rand_float();
         seed_colors[i].z = rand_float();
@@ -227,31 +443,471 @@ void generate_random_seeds(void)
         seed_velocities[i].x = cosf(angle)*mag;
         seed_velocities[i].y = sinf(angle)*mag;
     }
+
+    // After everything else, so the unweighted metrics keep the same seeds
+    bool weighted = metric == METRIC_POWER || metric == METRIC_ADDITIVE;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        seed_weights[i] = weighted ? rand_float()*max_weight : 0;
+    }
 }
 
-void render_frame(double delta_time)
+void set_metric_uniforms(GLuint program)
 {
-    glClearColor(0.25f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // TODO: resize the canvas when the window is resized
+    glUniform2f(glGetUniformLocation(program, "resolution"), screen_width, screen_height);
+    glUniform1f(glGetUniformLocation(program, "max_weight"), max_weight);
+}
+
+// The whole screen, narrowed down to the bounding box of the cell for the
+// Euclidean metric, the only one the Delaunay triangulation knows about. The
+// whole screen never changes, so it is uploaded only once
+void update_seed_bounds(void)
+{
+    static bool uploaded = false;
+    bool narrow = use_delaunay && metric == METRIC_EUCLIDEAN;
+    if (uploaded && !narrow) return;
+    uploaded = true;
+
+    for (size_t i = 0; i < seeds_count; ++i) {
+        Delaunay_Rect bbox = {0, 0, screen_width, screen_height};
+        if (narrow) delaunay_cell_bbox(&delaunay, i, &bbox);
+        seed_bounds[i] = (Vector4) {bbox.x0, bbox.y0, bbox.x1, bbox.y1};
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_BOUNDS]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, seeds_count*sizeof(*seed_bounds), seed_bounds);
+}
+
+void quads_init(void)
+{
+    GLuint program;
+    if (!load_shader_program("shaders/quad.vert", "shaders/color.frag", &program)) {
+        exit(1);
+    }
+    glUseProgram(program);
+    set_metric_uniforms(program);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Seed indices travel through the float textures and have to stay exact
+#define FLOAT_EXACT_SEEDS_COUNT (1 << 24)
+
+void jfa_init(void)
+{
+    // The seeds carry their index as a float and their colors come from a
+    // texture JFA_COLORS_WIDTH wide with one row per JFA_COLORS_WIDTH seeds
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    size_t max_seeds = (size_t)max_size*JFA_COLORS_WIDTH;
+    if (max_seeds > FLOAT_EXACT_SEEDS_COUNT) max_seeds = FLOAT_EXACT_SEEDS_COUNT;
+    if (seeds_count > max_seeds) {
+        fprintf(stderr, "ERROR: the jfa renderer supports at most %zu seeds\n", max_seeds);
+        exit(1);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        glGenTextures(1, &jfa_textures[i]);
+        glBindTexture(GL_TEXTURE_2D, jfa_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, screen_width, screen_height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &jfa_fbos[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, jfa_fbos[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, jfa_textures[i], 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "ERROR: Jump Flooding framebuffer is not complete: 0x%x\n", status);
+            exit(1);
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Seed i at (i%JFA_COLORS_WIDTH, i/JFA_COLORS_WIDTH), the last row may be partial
+    int colors_width = seeds_count < JFA_COLORS_WIDTH ? (int)seeds_count : JFA_COLORS_WIDTH;
+    int full_rows = seeds_count/colors_width;
+    int rest = seeds_count%colors_width;
+    glGenTextures(1, &jfa_colors_texture);
+    glBindTexture(GL_TEXTURE_2D, jfa_colors_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, colors_width, full_rows + (rest > 0), 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, colors_width, full_rows, GL_RGBA, GL_FLOAT, seed_colors);
+    if (rest > 0) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, full_rows, rest, 1, GL_RGBA, GL_FLOAT, &seed_colors[(size_t)full_rows*colors_width]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    if (!load_shader_program("shaders/jfa_seed.vert", "shaders/jfa_seed.frag", &jfa_seed_program)) exit(1);
+    if (!load_shader_program("shaders/fullscreen.vert", "shaders/jfa_step.frag", &jfa_step_program)) exit(1);
+    if (!load_shader_program("shaders/fullscreen.vert", "shaders/jfa_resolve.frag", &jfa_resolve_program)) exit(1);
+
+    glUseProgram(jfa_seed_program);
+    set_metric_uniforms(jfa_seed_program);
+    glUseProgram(jfa_step_program);
+    set_metric_uniforms(jfa_step_program);
+    glUniform1i(glGetUniformLocation(jfa_step_program, "seeds"), 0);
+    jfa_u_step = glGetUniformLocation(jfa_step_program, "step");
+    glUseProgram(jfa_resolve_program);
+    glUniform1i(glGetUniformLocation(jfa_resolve_program, "seeds"), 0);
+    glUniform1i(glGetUniformLocation(jfa_resolve_program, "colors"), 1);
+
+    int size = screen_width > screen_height ? screen_width : screen_height;
+    jfa_first_step = 1;
+    while (jfa_first_step < size) jfa_first_step *= 2;
+    jfa_first_step /= 2;
+
+    glDisable(GL_DEPTH_TEST);
+}
+
+// Splats the seeds into jfa_textures[0], floods them back and forth between
+// the two textures log2(max(screen_width, screen_height)) times and resolves
+// the result into colors. No pass looks at more than 9 texels per pixel, no
+// matter how many seeds there are.
+void render_jfa(void)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, jfa_fbos[0]);
+    glClearColor(0.0f, 0.0f, 0.0f, -1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(jfa_seed_program);
+    glDrawArraysInstanced(GL_POINTS, 0, 1, seeds_count);
+
+    size_t src = 0;
+    glUseProgram(jfa_step_program);
+    glActiveTexture(GL_TEXTURE0);
+    for (int step = jfa_first_step; step > 0; step /= 2) {
+        glBindFramebuffer(GL_FRAMEBUFFER, jfa_fbos[1 - src]);
+        glBindTexture(GL_TEXTURE_2D, jfa_textures[src]);
+        glUniform1i(jfa_u_step, step);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        src = 1 - src;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glUseProgram(jfa_resolve_program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, jfa_textures[src]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, jfa_colors_texture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void cones_init(void)
+{
+    if (!load_shader_program("shaders/cone.vert", "shaders/cone.frag", &cones_program)) exit(1);
+    if (!load_shader_program("shaders/marker.vert", "shaders/marker.frag", &markers_program)) exit(1);
+
+    // The balls of manhattan and chebyshev are squares, so their cones are
+    // exact pyramids. The power cones are flat and only have to cover the
+    // bounds of the cell.
+    float rim_angle = 0;
+    float rim_scale = 1;
+    switch (metric) {
+    case METRIC_MANHATTAN:
+        cone_segments = 4;
+        break;
+    case METRIC_CHEBYSHEV:
+        cone_segments = 4;
+        rim_angle = M_PI/4;
+        break;
+    case METRIC_POWER:
+        cone_segments = 4;
+        rim_angle = M_PI/4;
+        rim_scale = sqrtf(2);
+        break;
+    default:
+        cone_segments = CONE_SEGMENTS;
+        rim_scale = 1/cosf(M_PI/CONE_SEGMENTS);
+    }
+
+    glUseProgram(cones_program);
+    set_metric_uniforms(cones_program);
+    glUniform1i(glGetUniformLocation(cones_program, "segments"), cone_segments);
+    glUniform1f(glGetUniformLocation(cones_program, "rim_angle"), rim_angle);
+    glUniform1f(glGetUniformLocation(cones_program, "rim_scale"), rim_scale);
+    glUseProgram(markers_program);
+    set_metric_uniforms(markers_program);
+
+    glEnable(GL_DEPTH_TEST);
+    // The rims go way past the screen, their depth should not get clipped
+    glEnable(GL_DEPTH_CLAMP);
+}
+
+// Markers go first, so the cones never shade the pixels under them
+void render_cones(void)
+{
+    update_seed_bounds();
+    glUseProgram(markers_program);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, seeds_count);
+    glUseProgram(cones_program);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, cone_segments + 2, seeds_count);
+}
+
+GLuint create_buffer_texture(GLuint buffer, GLenum format)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    return texture;
+}
+
+void grid_init(void)
+{
+    // Roughly 2 seeds per cell
+    grid_cell_size = ceilf(sqrtf((float)screen_width*screen_height*2/seeds_count));
+    if (grid_cell_size < 1) grid_cell_size = 1;
+    grid_cols = (screen_width + grid_cell_size - 1)/grid_cell_size;
+    grid_rows = (screen_height + grid_cell_size - 1)/grid_cell_size;
+    size_t cells_count = (size_t)grid_cols*grid_rows;
+
+    // The seeds carry their index as a float
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    size_t max_seeds = (size_t)max_texels < FLOAT_EXACT_SEEDS_COUNT ? (size_t)max_texels : FLOAT_EXACT_SEEDS_COUNT;
+    if (cells_count + 1 > (size_t)max_texels || seeds_count > max_seeds) {
+        fprintf(stderr, "ERROR: the grid renderer supports at most %zu seeds\n", max_seeds);
+        exit(1);
+    }
+
+    grid_cells = malloc((cells_count + 1)*sizeof(*grid_cells));
+    grid_seeds = malloc(seeds_count*sizeof(*grid_seeds));
+    if (grid_cells == NULL || grid_seeds == NULL) {
+        fprintf(stderr, "ERROR: could not allocate memory for the grid of %zu seeds\n", seeds_count);
+        exit(1);
+    }
+
+    glGenBuffers(1, &grid_cells_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, grid_cells_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (cells_count + 1)*sizeof(*grid_cells), NULL, GL_STREAM_DRAW);
+    glGenBuffers(1, &grid_seeds_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, grid_seeds_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, seeds_count*sizeof(*grid_seeds), NULL, GL_STREAM_DRAW);
+    glGenBuffers(1, &grid_colors_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, grid_colors_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, seeds_count*sizeof(*seed_colors), seed_colors, GL_STATIC_DRAW);
+
+    // Nothing else binds textures, so they stay on units 0, 1 and 2
+    glActiveTexture(GL_TEXTURE0);
+    grid_textures[0] = create_buffer_texture(grid_cells_buffer, GL_R32UI);
+    glActiveTexture(GL_TEXTURE1);
+    grid_textures[1] = create_buffer_texture(grid_seeds_buffer, GL_RGBA32F);
+    glActiveTexture(GL_TEXTURE2);
+    grid_textures[2] = create_buffer_texture(grid_colors_buffer, GL_RGBA32F);
+
+    if (!load_shader_program("shaders/fullscreen.vert", "shaders/grid.frag", &grid_program)) exit(1);
+    glUseProgram(grid_program);
+    set_metric_uniforms(grid_program);
+    glUniform1i(glGetUniformLocation(grid_program, "cells"), 0);
+    glUniform1i(glGetUniformLocation(grid_program, "seeds"), 1);
+    glUniform1i(glGetUniformLocation(grid_program, "colors"), 2);
+    glUniform1i(glGetUniformLocation(grid_program, "cell_size"), grid_cell_size);
+    glUniform2i(glGetUniformLocation(grid_program, "grid_size"), grid_cols, grid_rows);
+
+    glDisable(GL_DEPTH_TEST);
+}
+
+static inline size_t grid_cell_of(Vector2 p)
+{
+    // Seeds may sit right on the right or top edge of the screen
+    int gx = (int)p.x/grid_cell_size;
+    int gy = (int)p.y/grid_cell_size;
+    if (gx >= grid_cols) gx = grid_cols - 1;
+    if (gy >= grid_rows) gy = grid_rows - 1;
+    return (size_t)gy*grid_cols + gx;
+}
+
+// Counting sort of the seeds into the cells, then one full screen pass that
+// only looks at the cells around every pixel
+void render_grid(void)
+{
+    size_t cells_count = (size_t)grid_cols*grid_rows;
+    memset(grid_cells, 0, (cells_count + 1)*sizeof(*grid_cells));
+    for (size_t i = 0; i < seeds_count; ++i) {
+        grid_cells[grid_cell_of(seed_positions[i]) + 1] += 1;
+    }
+    for (size_t i = 0; i < cells_count; ++i) {
+        grid_cells[i + 1] += grid_cells[i];
+    }
+    for (size_t i = 0; i < seeds_count; ++i) {
+        Vector2 p = seed_positions[i];
+        grid_seeds[grid_cells[grid_cell_of(p)]++] = (Vector4) {p.x, p.y, seed_weights[i], i};
+    }
+    for (size_t i = cells_count; i > 0; --i) {
+        grid_cells[i] = grid_cells[i - 1];
+    }
+    grid_cells[0] = 0;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, grid_cells_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, (cells_count + 1)*sizeof(*grid_cells), grid_cells);
+    glBindBuffer(GL_TEXTURE_BUFFER, grid_seeds_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, seeds_count*sizeof(*grid_seeds), grid_seeds);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
-        float x = seed_positions[i].x + seed_velocities[i].x*delta_time;
-        if (0 <= x && x <= DEFAULT_SCREEN_WIDTH) {
-            seed_positions[i].x = x;
+// Bounces off the edges of the screen by staying in place for the step.
+// All in float, shaders/simulate.vert does exactly the same.
+void move_seeds(Vector2 *positions, Vector2 *velocities, float delta_time)
+{
+    for (size_t i = 0; i < seeds_count; ++i) {
+        float x = positions[i].x + velocities[i].x*delta_time;
+        if (0 <= x && x <= screen_width) {
+            positions[i].x = x;
         } else {
-            seed_velocities[i].x *= -1;
+            velocities[i].x *= -1;
         }
-        float y = seed_positions[i].y + seed_velocities[i].y*delta_time;
-        if (0 <= y && y <= DEFAULT_SCREEN_HEIGHT) {
-            seed_positions[i].y = y;
+        float y = positions[i].y + velocities[i].y*delta_time;
+        if (0 <= y && y <= screen_height) {
+            positions[i].y = y;
         } else {
-            seed_velocities[i].y *= -1;
+            velocities[i].y *= -1;
         }
     }
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_POS]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(seed_positions), seed_positions);
+}
 
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, SEEDS_COUNT);
+void simulation_init(void)
+{
+    GLuint vert = 0;
+    if (!compile_shader_file("shaders/simulate.vert", NULL, GL_VERTEX_SHADER, &vert)) exit(1);
+    simulation_program = glCreateProgram();
+    glAttachShader(simulation_program, vert);
+    const char *varyings[] = {"next_pos", "next_velocity"};
+    glTransformFeedbackVaryings(simulation_program, 2, varyings, GL_SEPARATE_ATTRIBS);
+    glLinkProgram(simulation_program);
+    glDeleteShader(vert);
+    GLint linked = 0;
+    glGetProgramiv(simulation_program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLsizei message_size = 0;
+        GLchar message[1024];
+        glGetProgramInfoLog(simulation_program, sizeof(message), &message_size, message);
+        fprintf(stderr, "ERROR: could not link `shaders/simulate.vert`: %.*s\n", message_size, message);
+        exit(1);
+    }
+    glUseProgram(simulation_program);
+    glUniform2f(glGetUniformLocation(simulation_program, "resolution"), screen_width, screen_height);
+    simulation_u_delta_time = glGetUniformLocation(simulation_program, "delta_time");
+
+    for (size_t i = 0; i < 2; ++i) {
+        glGenBuffers(1, &simulation_positions[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, simulation_positions[i]);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_positions), seed_positions, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &simulation_velocities[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, simulation_velocities[i]);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_velocities), seed_velocities, GL_DYNAMIC_COPY);
+
+        // Reads pair i, the step writes the other one
+        glGenVertexArrays(1, &simulation_vaos[i]);
+        glBindVertexArray(simulation_vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, simulation_positions[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, simulation_velocities[i]);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
+    glBindVertexArray(vao);
+    simulation_current = 0;
+
+    if (check_simulation) {
+        check_positions = malloc(seeds_count*sizeof(*check_positions));
+        check_velocities = malloc(seeds_count*sizeof(*check_velocities));
+        if (check_positions == NULL || check_velocities == NULL) {
+            fprintf(stderr, "ERROR: could not allocate memory for checking the simulation of %zu seeds\n", seeds_count);
+            exit(1);
+        }
+        memcpy(check_positions, seed_positions, seeds_count*sizeof(*check_positions));
+        memcpy(check_velocities, seed_velocities, seeds_count*sizeof(*check_velocities));
+    }
+}
+
+// One step of the seeds from the current pair of buffers into the other
+// one, which the renderers then read the positions from
+void simulate_seeds_on_gpu(float delta_time)
+{
+    size_t next = 1 - simulation_current;
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    glUseProgram(simulation_program);
+    glUniform1f(simulation_u_delta_time, delta_time);
+    glBindVertexArray(simulation_vaos[simulation_current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, simulation_positions[next]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, simulation_velocities[next]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, seeds_count);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+    simulation_current = next;
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, simulation_positions[next]);
+    glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glUseProgram(program);
+
+    // The triangulation follows the seeds on the CPU, one readback costs far
+    // less than quads and cones covering the whole screen
+    if (check_simulation || use_delaunay) {
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, seeds_count*sizeof(*seed_positions), seed_positions);
+    }
+
+    if (check_simulation) {
+        glBindBuffer(GL_ARRAY_BUFFER, simulation_velocities[next]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, seeds_count*sizeof(*seed_velocities), seed_velocities);
+        move_seeds(check_positions, check_velocities, delta_time);
+        for (size_t i = 0; i < seeds_count; ++i) {
+            if (memcmp(&seed_positions[i], &check_positions[i], sizeof(Vector2)) != 0 ||
+                memcmp(&seed_velocities[i], &check_velocities[i], sizeof(Vector2)) != 0) {
+                fprintf(stderr, "ERROR: GPU simulation diverged at seed %zu: position (%.9g, %.9g) velocity (%.9g, %.9g), CPU has position (%.9g, %.9g) velocity (%.9g, %.9g)\n",
+                        i, seed_positions[i].x, seed_positions[i].y, seed_velocities[i].x, seed_velocities[i].y,
+                        check_positions[i].x, check_positions[i].y, check_velocities[i].x, check_velocities[i].y);
+                exit(1);
+            }
+        }
+    }
+}
+
+void render_frame(double delta_time)
+{
+    glClearColor(0.25f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (gpu_simulation) {
+        // A power of two step is multiplied exactly, so whether the GPU
+        // fuses the multiply and add does not change a single bit
+        if (check_simulation) delta_time = 1.0/64;
+        simulate_seeds_on_gpu(delta_time);
+    } else {
+        move_seeds(seed_positions, seed_velocities, delta_time);
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_POS]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, seeds_count*sizeof(*seed_positions), seed_positions);
+    }
+    if (use_delaunay) {
+        for (size_t i = 0; i < seeds_count; ++i) {
+            delaunay_move(&delaunay, i, seed_positions[i].x, seed_positions[i].y);
+        }
+    }
+    if (check_delaunay && !delaunay_check(&delaunay)) exit(1);
+
+    switch (renderer) {
+    case RENDERER_QUADS:
+        update_seed_bounds();
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, seeds_count);
+        break;
+    case RENDERER_JFA:
+        render_jfa();
+        break;
+    case RENDERER_CONES:
+        render_cones();
+        break;
+    case RENDERER_GRID:
+        render_grid();
+        break;
+    default:
+        UNREACHABLE("Unexpected renderer");
+    }
 }
 
 void render_video_mode(GLFWwindow *window)
@@ -263,7 +919,6 @@ void render_video_mode(GLFWwindow *window)
         exit(1);
     }
 
-    static uint32_t frame_pixels[DEFAULT_SCREEN_HEIGHT][DEFAULT_SCREEN_WIDTH];
     static char file_path[1024];
 
     size_t fps = 60;
@@ -271,19 +926,42 @@ void render_video_mode(GLFWwindow *window)
     double duration = 10.0;
     size_t frames_count = floorf(duration/delta_time);
 
+    // How long a frame takes until the GPU is done with it and how many
+    // fragments make it past the depth test, to compare the renderers
+    GLuint samples_query;
+    glGenQueries(1, &samples_query);
+    double total_time = 0;
+    GLuint64 total_samples = 0;
+    size_t rendered = 0;
+
     for (size_t i = 0; i < frames_count && !glfwWindowShouldClose(window); ++i) {
+        glFinish();
+        double start = glfwGetTime();
+        glBeginQuery(GL_SAMPLES_PASSED, samples_query);
         render_frame(delta_time);
+        glEndQuery(GL_SAMPLES_PASSED);
+        glFinish();
+        double time = glfwGetTime() - start;
+
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(samples_query, GL_QUERY_RESULT, &samples);
+        // The first frame pays for the lazy setup of the driver
+        if (i > 0) {
+            total_time += time;
+            total_samples += samples;
+            rendered += 1;
+        }
 
         glReadPixels(0,
                      0,
-                     DEFAULT_SCREEN_WIDTH,
-                     DEFAULT_SCREEN_HEIGHT,
+                     screen_width,
+                     screen_height,
                      GL_RGBA,
                      GL_UNSIGNED_BYTE,
                      frame_pixels);
 
         snprintf(file_path, sizeof(file_path), "%s/frame-%03zu.png", output_dir, i);
-        if (!stbi_write_png(file_path, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT, 4, frame_pixels, sizeof(uint32_t)*DEFAULT_SCREEN_WIDTH)) {
+        if (!stbi_write_png(file_path, screen_width, screen_height, 4, frame_pixels, sizeof(uint32_t)*screen_width)) {
             fprintf(stderr, "ERROR: could not save file %s\n", file_path);
             exit(1);
         }
@@ -293,6 +971,13 @@ void render_video_mode(GLFWwindow *window)
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+
+    if (rendered > 0) {
+        printf("INFO: %s renderer: %.3f ms per frame, %.2f fragments per pixel passed the depth test\n",
+               renderer_names[renderer],
+               total_time*1000/rendered,
+               (double)total_samples/rendered/((double)screen_width*screen_height));
+    }
 }
 
 void interactive_mode(GLFWwindow *window)
@@ -317,6 +1002,24 @@ typedef enum {
     MODE_RENDER_VIDEO,
 } Mode;
 
+long parse_flag_number(int argc, char **argv, int *i, long min, long max)
+{
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "ERROR: no value provided for flag `%s`\n", argv[*i]);
+        exit(1);
+    }
+    *i += 1;
+    char *end = NULL;
+    errno = 0;
+    long n = strtol(argv[*i], &end, 10);
+    if (*argv[*i] == '\0' || *end != '\0' || errno != 0 || n < min || n > max) {
+        fprintf(stderr, "ERROR: `%s` is not a valid value for flag `%s`, expected a number in [%ld, %ld]\n",
+                argv[*i], argv[*i - 1], min, max);
+        exit(1);
+    }
+    return n;
+}
+
 int main(int argc, char **argv)
 {
     Mode mode = MODE_INTERACTIVE;
@@ -324,14 +1027,80 @@ int main(int argc, char **argv)
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--video") == 0) {
             mode = MODE_RENDER_VIDEO;
+        } else if (strcmp(argv[i], "--width") == 0) {
+            screen_width = parse_flag_number(argc, argv, &i, 1, 16384);
+        } else if (strcmp(argv[i], "--height") == 0) {
+            screen_height = parse_flag_number(argc, argv, &i, 1, 16384);
+        } else if (strcmp(argv[i], "--seeds") == 0) {
+            seeds_count = parse_flag_number(argc, argv, &i, 1, INT32_MAX);
+        } else if (strcmp(argv[i], "--metric") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "ERROR: no value provided for flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            i += 1;
+            metric = COUNT_METRICS;
+            for (size_t j = 0; j < COUNT_METRICS; ++j) {
+                if (strcmp(argv[i], metric_names[j]) == 0) {
+                    metric = j;
+                    break;
+                }
+            }
+            if (metric == COUNT_METRICS) {
+                fprintf(stderr, "ERROR: unknown metric `%s`\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--renderer") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "ERROR: no value provided for flag `%s`\n", argv[i]);
+                exit(1);
+            }
+            i += 1;
+            renderer = COUNT_RENDERERS;
+            for (size_t j = 0; j < COUNT_RENDERERS; ++j) {
+                if (strcmp(argv[i], renderer_names[j]) == 0) {
+                    renderer = j;
+                    break;
+                }
+            }
+            if (renderer == COUNT_RENDERERS) {
+                fprintf(stderr, "ERROR: unknown renderer `%s`\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-weight") == 0) {
+            max_weight = parse_flag_number(argc, argv, &i, 0, 16384);
+        } else if (strcmp(argv[i], "--check-delaunay") == 0) {
+            check_delaunay = true;
+        } else if (strcmp(argv[i], "--gpu-simulation") == 0) {
+            gpu_simulation = true;
+        } else if (strcmp(argv[i], "--check-simulation") == 0) {
+            gpu_simulation = true;
+            check_simulation = true;
         } else {
             fprintf(stderr, "ERROR: unknown flag `%s`\n", argv[i]);
             exit(1);
         }
     }
 
+    if (gpu_simulation && renderer == RENDERER_GRID) {
+        fprintf(stderr, "ERROR: --gpu-simulation does not work with the grid renderer, it bins the seeds on the CPU\n");
+        exit(1);
+    }
+
+    alloc_buffers();
     generate_random_seeds();
 
+    // Only the bounds of the cells for quads and cones with the Euclidean
+    // metric come from the triangulation, everything else is better off
+    // without its upkeep
+    use_delaunay = ((renderer == RENDERER_QUADS || renderer == RENDERER_CONES) && metric == METRIC_EUCLIDEAN) || check_delaunay;
+    if (use_delaunay) {
+        delaunay_init(&delaunay, screen_width, screen_height);
+        for (size_t i = 0; i < seeds_count; ++i) {
+            delaunay_insert(&delaunay, i, seed_positions[i].x, seed_positions[i].y);
+        }
+    }
+
     if (!glfwInit()) {
         fprintf(stderr, "ERROR: could not initialize GLFW\n");
         exit(1);
@@ -343,8 +1112,8 @@ int main(int argc, char **argv)
 
 
     GLFWwindow * const window = glfwCreateWindow(
-                                    DEFAULT_SCREEN_WIDTH,
-                                    DEFAULT_SCREEN_HEIGHT,
+                                    screen_width,
+                                    screen_height,
                                     "OpenGL Template",
                                     NULL,
                                     NULL);
@@ -372,8 +1141,6 @@ int main(int argc, char **argv)
         glDebugMessageCallback(MessageCallback, 0);
     }
 
-    glEnable(GL_DEPTH_TEST);
-
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
@@ -382,7 +1149,7 @@ int main(int argc, char **argv)
     {
         glGenBuffers(1, &vbos[ATTRIB_POS]);
         glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_POS]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(seed_positions), seed_positions, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_positions), seed_positions, GL_DYNAMIC_DRAW);
 
         glEnableVertexAttribArray(ATTRIB_POS);
         glVertexAttribPointer(ATTRIB_POS,
@@ -397,7 +1164,7 @@ int main(int argc, char **argv)
     {
         glGenBuffers(1, &vbos[ATTRIB_COLOR]);
         glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_COLOR]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(seed_colors), seed_colors, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_colors), seed_colors, GL_STATIC_DRAW);
 
         glEnableVertexAttribArray(ATTRIB_COLOR);
         glVertexAttribPointer(ATTRIB_COLOR,
@@ -409,17 +1176,54 @@ int main(int argc, char **argv)
         glVertexAttribDivisor(ATTRIB_COLOR, 1);
     }
 
-    const char *vertex_file_path = "shaders/quad.vert";
-    const char *fragment_file_path = "shaders/color.frag";
-    GLuint program;
-    if (!load_shader_program(vertex_file_path, fragment_file_path, &program)) {
-        exit(1);
+    {
+        glGenBuffers(1, &vbos[ATTRIB_WEIGHT]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_WEIGHT]);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_weights), seed_weights, GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(ATTRIB_WEIGHT);
+        glVertexAttribPointer(ATTRIB_WEIGHT,
+                              1,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              0,
+                              (void*)0);
+        glVertexAttribDivisor(ATTRIB_WEIGHT, 1);
     }
-    glUseProgram(program);
 
-    // TODO: resize the canvas when the window is resized
-    GLint u_resolution = glGetUniformLocation(program, "resolution");
-    glUniform2f(u_resolution, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    {
+        glGenBuffers(1, &vbos[ATTRIB_BOUNDS]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[ATTRIB_BOUNDS]);
+        glBufferData(GL_ARRAY_BUFFER, seeds_count*sizeof(*seed_bounds), NULL, GL_DYNAMIC_DRAW);
+
+        glEnableVertexAttribArray(ATTRIB_BOUNDS);
+        glVertexAttribPointer(ATTRIB_BOUNDS,
+                              4,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              0,
+                              (void*)0);
+        glVertexAttribDivisor(ATTRIB_BOUNDS, 1);
+    }
+
+    if (gpu_simulation) simulation_init();
+
+    switch (renderer) {
+    case RENDERER_QUADS:
+        quads_init();
+        break;
+    case RENDERER_JFA:
+        jfa_init();
+        break;
+    case RENDERER_CONES:
+        cones_init();
+        break;
+    case RENDERER_GRID:
+        grid_init();
+        break;
+    default:
+        UNREACHABLE("Unexpected renderer");
+    }
 
     switch (mode) {
     case MODE_INTERACTIVE:
@@ -2,16 +2,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
 #include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
-#define WIDTH 800
-#define HEIGHT 600
-#define SEEDS_COUNT 20
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#include "kdtree.c"
+
+#define DEFAULT_WIDTH 800
+#define DEFAULT_HEIGHT 600
+#define DEFAULT_SEEDS_COUNT 20
+#define MAX_CANVAS_SIZE (1 << 20)
+// Weights of the power and additive metrics, in pixels
+#define DEFAULT_MAX_WEIGHT 50
+#define MAX_WEIGHT (1 << 14)
+
+// Engines only rasterize the index of the closest seed per pixel. -DLABEL_BITS=16
+// halves the label map at the cost of limiting the seeds count.
+#ifndef LABEL_BITS
+#define LABEL_BITS 32
+#endif
+
+#if LABEL_BITS == 32
+typedef uint32_t Label;
+#define LABEL_NONE UINT32_MAX
+#elif LABEL_BITS == 16
+typedef uint16_t Label;
+#define LABEL_NONE UINT16_MAX
+#else
+#error "LABEL_BITS must be 16 or 32"
+#endif
+
+// LABEL_NONE is reserved for "no seed"
+#define MAX_SEEDS_COUNT (LABEL_NONE - 1)
 
 #define OUTPUT_FILE_PATH "output.ppm"
+#define MAX_OUTPUTS 8
 
 #define COLOR_WHITE 0xFFFFFFFF
 #define COLOR_BLACK 0xFF000000
@@ -32,6 +72,18 @@
 #define SEED_MARKER_RADIUS 5
 #define SEED_MARKER_COLOR COLOR_BLACK
 
+#define JFA_EMPTY UINT32_MAX
+
+// 64x64 pixels of labels plus depth is 32KB, fits into L1/L2
+#define TILE_SIZE 64
+#define MAX_THREADS 256
+
+#define UNREACHABLE(message) \
+    do { \
+        fprintf(stderr, "%s:%d: UNREACHABLE: %s\n", __FILE__, __LINE__, message); \
+        exit(1); \
+    } while (0)
+
 typedef uint32_t Color32;
 
 typedef struct {
@@ -43,9 +95,64 @@ typedef struct {
     uint16_t y;
 } Point32;
 
-static Color32 image[HEIGHT][WIDTH];
-static int depth[HEIGHT][WIDTH];
-static Point seeds[SEEDS_COUNT];
+// All the buffers live in one arena that is reserved up front and reused
+// across renders. Only touched pages ever get committed.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} Arena;
+
+static Arena arena;
+// Everything allocated after this mark is scratch of the current render
+static size_t arena_render_mark;
+
+static int canvas_width = DEFAULT_WIDTH;
+static int canvas_height = DEFAULT_HEIGHT;
+static size_t seeds_count = DEFAULT_SEEDS_COUNT;
+// Room in seeds for the ones the dynamic engine inserts later
+static size_t seeds_capacity;
+// NULL means that all the seeds are alive, see the dynamic engine
+static bool *seed_alive;
+
+// Index of the closest seed of every pixel, row major, pixel (x, y) is at
+// [(y - labels_y0)*canvas_width + x]. Everything but the banded mode keeps
+// the whole canvas in it.
+static Label *labels;
+static int labels_y0 = 0;
+static int labels_rows = DEFAULT_HEIGHT;
+// Colors of a few rows of the labels at a time, see resolve_labels()
+static Color32 *image;
+static int image_y0 = 0;
+static int image_rows = 0;
+// Alive seeds sorted by y, so resolve_labels() can find the markers of its rows
+static uint32_t *markers_order;
+static size_t markers_count;
+// TILE_SIZE*TILE_SIZE per worker, the interesting engine only needs the
+// depth of the tile it is working on
+static int *tile_depths;
+static Point *seeds;
+// Only the power and additive metrics look at them, zero otherwise
+static int *seed_weights;
+static int max_weight = DEFAULT_MAX_WEIGHT;
+static uint32_t *jfa_buffers[2];
+// Vertical distance from every pixel to the closest seed of its column
+static int *edt_dy;
+// Distance from every pixel to its seed, only when asked to export it
+static bool edt_export_distances = false;
+static float *edt_distances;
+// Scratch of the row pass of the edt engine, canvas_width per worker
+static int *edt_hull;
+static int64_t *edt_starts;
+static Label *edt_column_labels;
+// Uniform grid over the seeds. Seeds of cell i are
+// grid_seeds[grid_cells[i]..grid_cells[i + 1]] in increasing index order.
+static int grid_cell_size;
+static int grid_cols;
+static int grid_rows;
+static uint32_t *grid_cells;
+static uint32_t *grid_seeds;
+static Label *reference_labels;
 static Color32 palette[] = {
     GRUVBOX_BRIGHT_RED,
     GRUVBOX_BRIGHT_GREEN,
@@ -57,22 +164,107 @@ static Color32 palette[] = {
 };
 #define palette_count (sizeof(palette)/sizeof(palette[0]))
 
-void fill_image(Color32 color)
+#define ARENA_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2*1024*1024)
+// Pixels resolve_labels() and Image_Writer convert at once
+#define WRITE_CHUNK_PIXELS (256*1024)
+
+void arena_reserve(Arena *a, size_t capacity)
 {
-    for (size_t y = 0; y < HEIGHT; ++y) {
-        for (size_t x = 0; x < WIDTH; ++x) {
-            image[y][x] = color;
-        }
+    capacity = (capacity + HUGE_PAGE_SIZE - 1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+    // Extra huge page to align the start to a huge page boundary
+    size_t mapped = capacity + HUGE_PAGE_SIZE;
+    char *data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not reserve %zu bytes: %s\n", mapped, strerror(errno));
+        exit(1);
+    }
+    a->data = (char*)(((uintptr_t)data + HUGE_PAGE_SIZE - 1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+    madvise(a->data, capacity, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+    a->size = 0;
+    a->capacity = capacity;
+}
+
+void *arena_alloc(Arena *a, size_t size)
+{
+    size_t start = (a->size + ARENA_ALIGNMENT - 1)/ARENA_ALIGNMENT*ARENA_ALIGNMENT;
+    if (start + size > a->capacity) {
+        fprintf(stderr, "ERROR: arena is out of memory, %zu more bytes requested\n", size);
+        exit(1);
+    }
+    a->size = start + size;
+    return a->data + start;
+}
+
+size_t pixels_count(void)
+{
+    return (size_t)canvas_width*canvas_height;
+}
+
+// Rows of colors resolve_labels() works on at once
+int image_rows_capacity(void)
+{
+    int rows = WRITE_CHUNK_PIXELS/canvas_width;
+    return rows > 0 ? rows : 1;
+}
+
+// Upper bound of everything any engine allocates from the arena when the
+// labels hold `rows` rows of the canvas
+size_t arena_capacity_needed(int rows, size_t threads_count)
+{
+    // Per pixel scratch of the jfa engine is the biggest one, edt needs
+    // edt_dy plus edt_distances. The kdtree engine queries as many pixels
+    // at once as resolve_labels() resolves.
+    return (size_t)canvas_width*rows*(sizeof(*labels) + 2*sizeof(**jfa_buffers) + sizeof(*reference_labels))
+        + (size_t)canvas_width*image_rows_capacity()*(sizeof(*image) + 2*sizeof(double) + sizeof(uint32_t))
+        + threads_count*TILE_SIZE*TILE_SIZE*sizeof(*tile_depths)
+        + threads_count*canvas_width*(sizeof(*edt_hull) + sizeof(*edt_starts) + sizeof(*edt_column_labels))
+        // Per worker hull, starts and sums of lloyd_relax(), then the per
+        // worker cell_stats and cell_adjacency_heads
+        + threads_count*seeds_capacity*(sizeof(uint32_t) + 4*sizeof(int64_t))
+        + threads_count*seeds_capacity*(2*sizeof(int64_t) + 4*sizeof(int) + sizeof(uint32_t))
+        + seeds_capacity*128
+        + seeds_capacity*sizeof(*seed_weights)
+        + ((size_t)canvas_width + canvas_height)*16
+        + MAX_OUTPUTS*3*WRITE_CHUNK_PIXELS
+        + 64*ARENA_ALIGNMENT;
+}
+
+void fill_row(Label *row, size_t count, Label label)
+{
+    for (size_t i = 0; i < count; ++i) {
+        row[i] = label;
     }
 }
 
-int sqr_dist(int x1, int y1, int x2, int y2)
+void clear_labels(void)
+{
+    fill_row(labels, (size_t)canvas_width*labels_rows, LABEL_NONE);
+}
+
+int64_t sqr_dist(int x1, int y1, int x2, int y2)
 {
-    int dx = x1 - x2;
-    int dy = y1 - y2;
+    int64_t dx = x1 - x2;
+    int64_t dy = y1 - y2;
     return dx*dx + dy*dy;
 }
 
+double get_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+int ceil_sqrt(size_t n)
+{
+    size_t r = 0;
+    while (r*r < n) r += 1;
+    return r;
+}
+
 void fill_circle(int cx, int cy, int radius, uint32_t color)
 {
     // .......
@@ -86,11 +278,11 @@ void fill_circle(int cx, int cy, int radius, uint32_t color)
     int x1 = cx + radius;
     int y1 = cy + radius;
     for (int x = x0; x <= x1; ++x) {
-        if (0 <= x && x < WIDTH) {
+        if (0 <= x && x < canvas_width) {
             for (int y = y0; y <= y1; ++y) {
-                if (0 <= y && y < HEIGHT) {
+                if (image_y0 <= y && y < image_y0 + image_rows) {
                     if (sqr_dist(cx, cy, x, y) <= radius*radius) {
-                        image[y][x] = color;
+                        image[(size_t)(y - image_y0)*canvas_width + x] = color;
                     }
                 }
             }
@@ -98,59 +290,53 @@ void fill_circle(int cx, int cy, int radius, uint32_t color)
     }
 }
 
-void save_image_as_ppm(const char *file_path)
+void generate_random_seeds(void)
 {
-    FILE *f = fopen(file_path, "wb");
-    if (f == NULL) {
-        fprintf(stderr, "ERROR: could write into file %s: %s\n", file_path, strerror(errno));
-        exit(1);
+    for (size_t i = 0; i < seeds_count; ++i) {
+        seeds[i].x = rand()%canvas_width;
+        seeds[i].y = rand()%canvas_height;
     }
-    fprintf(f, "P6\n%d %d 255\n", WIDTH, HEIGHT);
-    for (size_t y = 0; y < HEIGHT; ++y) {
-        for (size_t x = 0; x < WIDTH; ++x) {
-            // 0xAABBGGRR
-            uint32_t pixel = image[y][x];
-            uint8_t bytes[3] = {
-                (pixel&0x0000FF)>>8*0,
-                (pixel&0x00FF00)>>8*1,
-                (pixel&0xFF0000)>>8*2,
-            };
-            fwrite(bytes, sizeof(bytes), 1, f);
-            assert(!ferror(f));
-        }
+}
+
+// After the positions, so the unweighted metrics keep the same seeds
+void generate_random_weights(void)
+{
+    for (size_t i = 0; i < seeds_count; ++i) {
+        seed_weights[i] = rand()%(max_weight + 1);
     }
+}
 
-    int ret = fclose(f);
-    assert(ret == 0);
+int compare_markers_order(const void *a, const void *b)
+{
+    int ya = seeds[*(const uint32_t*)a].y;
+    int yb = seeds[*(const uint32_t*)b].y;
+    return ya < yb ? -1 : ya > yb;
 }
 
-void generate_random_seeds(void)
+void sort_seed_markers(void)
 {
-    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
-        seeds[i].x = rand()%WIDTH;
-        seeds[i].y = rand()%HEIGHT;
+    markers_count = 0;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        if (seed_alive == NULL || seed_alive[i]) markers_order[markers_count++] = i;
     }
+    qsort(markers_order, markers_count, sizeof(*markers_order), compare_markers_order);
 }
 
+// Draws the markers that reach into the rows of image
 void render_seed_markers(void)
 {
-    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
-        fill_circle(seeds[i].x, seeds[i].y, SEED_MARKER_RADIUS, SEED_MARKER_COLOR);
+    // First seed in markers_order whose marker is not above image
+    size_t lo = 0, hi = markers_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if (seeds[markers_order[mid]].y + SEED_MARKER_RADIUS < image_y0) lo = mid + 1;
+        else hi = mid;
     }
-}
 
-void render_voronoi_naive(void)
-{
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            int j = 0;
-            for (size_t i = 1; i < SEEDS_COUNT; ++i) {
-                if (sqr_dist(seeds[i].x, seeds[i].y, x, y) < sqr_dist(seeds[j].x, seeds[j].y, x, y)) {
-                    j = i;
-                }
-            }
-            image[y][x] = palette[j%palette_count];
-        }
+    for (size_t k = lo; k < markers_count; ++k) {
+        Point seed = seeds[markers_order[k]];
+        if (seed.y - SEED_MARKER_RADIUS >= image_y0 + image_rows) break;
+        fill_circle(seed.x, seed.y, SEED_MARKER_RADIUS, SEED_MARKER_COLOR);
     }
 }
 
@@ -173,54 +359,3019 @@ Point color_to_point(Color32 c)
     };
 }
 
-void render_point_gradient(void)
+typedef enum {
+    METRIC_EUCLIDEAN = 0,
+    METRIC_MANHATTAN,
+    METRIC_CHEBYSHEV,
+    METRIC_MINKOWSKI,
+    METRIC_POWER,
+    METRIC_ADDITIVE,
+    COUNT_METRICS,
+} Metric;
+
+static const char *metric_names[COUNT_METRICS] = {
+    [METRIC_EUCLIDEAN] = "euclidean",
+    [METRIC_MANHATTAN] = "manhattan",
+    [METRIC_CHEBYSHEV] = "chebyshev",
+    [METRIC_MINKOWSKI] = "minkowski",
+    [METRIC_POWER]     = "power",
+    [METRIC_ADDITIVE]  = "additive",
+};
+
+static Metric metric = METRIC_EUCLIDEAN;
+
+// The p of the minkowski metric is baked into its kernels
+#ifndef MINKOWSKI_P
+#define MINKOWSKI_P 3
+#endif
+#if MINKOWSKI_P < 1
+#error "MINKOWSKI_P must be at least 1"
+#endif
+
+#define METRIC_ABS(a) ((a) < 0 ? -(a) : (a))
+#define METRIC_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+int64_t minkowski_pow(int64_t a)
+{
+    int64_t r = a;
+    for (int i = 1; i < MINKOWSKI_P; ++i) r *= a;
+    return r;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse4.1")))
+static inline __m128i minkowski_pow_sse41(__m128i a)
+{
+    __m128i r = a;
+    for (int i = 1; i < MINKOWSKI_P; ++i) r = _mm_mullo_epi32(r, a);
+    return r;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i minkowski_pow_avx2(__m256i a)
+{
+    __m256i r = a;
+    for (int i = 1; i < MINKOWSKI_P; ++i) r = _mm256_mullo_epi32(r, a);
+    return r;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i minkowski_pow_avx512(__m512i a)
+{
+    __m512i r = a;
+    for (int i = 1; i < MINKOWSKI_P; ++i) r = _mm512_mullo_epi32(r, a);
+    return r;
+}
+#endif // SIMD_X86
+
+// sqrt(d2) + bias as float bits. Non-negative floats compare the same way as
+// their bits do as integers, so these depths go through the same integer
+// depth buffer as the others. The vector kernels round exactly the same way.
+int additive_depth(int64_t d2, int bias)
+{
+    float f = sqrtf((float)d2) + (float)bias;
+    int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse4.1")))
+static inline __m128i additive_depth_sse41(__m128i d2, __m128i bias)
+{
+    return _mm_castps_si128(_mm_add_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(d2)), _mm_cvtepi32_ps(bias)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i additive_depth_avx2(__m256i d2, __m256i bias)
+{
+    return _mm256_castps_si256(_mm256_add_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(d2)), _mm256_cvtepi32_ps(bias)));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i additive_depth_avx512(__m512i d2, __m512i bias)
+{
+    return _mm512_castps_si512(_mm512_add_ps(_mm512_sqrt_ps(_mm512_cvtepi32_ps(d2)), _mm512_cvtepi32_ps(bias)));
+}
+#endif // SIMD_X86
+
+// Largest depth on the canvas under the current metric, or of an
+// intermediate value of it, as a double so it can be checked against the
+// depth types without overflowing itself
+double metric_max_depth(void)
+{
+    double w = canvas_width - 1;
+    double h = canvas_height - 1;
+    switch (metric) {
+    case METRIC_EUCLIDEAN: return w*w + h*h;
+    case METRIC_MANHATTAN: return w + h;
+    case METRIC_CHEBYSHEV: return w > h ? w : h;
+    case METRIC_MINKOWSKI: return pow(w, MINKOWSKI_P) + pow(h, MINKOWSKI_P);
+    // Weights only lower the depth, the additive one is bounded by the
+    // squared distance it takes the root of
+    case METRIC_POWER:
+    case METRIC_ADDITIVE:  return w*w + h*h;
+    default: UNREACHABLE("Unexpected metric");
+    }
+}
+
+// Kernels for one row of a tile of the interesting engine. dx0 is the
+// horizontal distance from the first pixel to the seed, dy is the vertical
+// distance from the row to the seed, weight is the weight of the seed.
+typedef void (*Apply_Seed_Row)(int *depth_row, Label *label_row, int count, int dx0, int dy, int weight, Label label);
+
+#define METRIC_NAME euclidean
+#define METRIC_ROW(dy, w) ((dy)*(dy))
+#define METRIC_BIAS(w) 0
+#define METRIC_DEPTH(dx, row, bias) ((dx)*(dx) + (row))
+#define METRIC_DEPTH_SSE41(dx, row, bias) _mm_add_epi32(_mm_mullo_epi32(dx, dx), row)
+#define METRIC_DEPTH_AVX2(dx, row, bias) _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), row)
+#define METRIC_DEPTH_AVX512(dx, row, bias) _mm512_add_epi32(_mm512_mullo_epi32(dx, dx), row)
+#include "metric_kernels.c"
+
+#define METRIC_NAME manhattan
+#define METRIC_ROW(dy, w) METRIC_ABS(dy)
+#define METRIC_BIAS(w) 0
+#define METRIC_DEPTH(dx, row, bias) (METRIC_ABS(dx) + (row))
+#define METRIC_DEPTH_SSE41(dx, row, bias) _mm_add_epi32(_mm_abs_epi32(dx), row)
+#define METRIC_DEPTH_AVX2(dx, row, bias) _mm256_add_epi32(_mm256_abs_epi32(dx), row)
+#define METRIC_DEPTH_AVX512(dx, row, bias) _mm512_add_epi32(_mm512_abs_epi32(dx), row)
+#include "metric_kernels.c"
+
+#define METRIC_NAME chebyshev
+#define METRIC_ROW(dy, w) METRIC_ABS(dy)
+#define METRIC_BIAS(w) 0
+#define METRIC_DEPTH(dx, row, bias) METRIC_MAX(METRIC_ABS(dx), row)
+#define METRIC_DEPTH_SSE41(dx, row, bias) _mm_max_epi32(_mm_abs_epi32(dx), row)
+#define METRIC_DEPTH_AVX2(dx, row, bias) _mm256_max_epi32(_mm256_abs_epi32(dx), row)
+#define METRIC_DEPTH_AVX512(dx, row, bias) _mm512_max_epi32(_mm512_abs_epi32(dx), row)
+#include "metric_kernels.c"
+
+// Sum of the p-th powers without the p-th root
+#define METRIC_NAME minkowski
+#define METRIC_ROW(dy, w) minkowski_pow(METRIC_ABS(dy))
+#define METRIC_BIAS(w) 0
+#define METRIC_DEPTH(dx, row, bias) (minkowski_pow(METRIC_ABS(dx)) + (row))
+#define METRIC_DEPTH_SSE41(dx, row, bias) _mm_add_epi32(minkowski_pow_sse41(_mm_abs_epi32(dx)), row)
+#define METRIC_DEPTH_AVX2(dx, row, bias) _mm256_add_epi32(minkowski_pow_avx2(_mm256_abs_epi32(dx)), row)
+#define METRIC_DEPTH_AVX512(dx, row, bias) _mm512_add_epi32(minkowski_pow_avx512(_mm512_abs_epi32(dx)), row)
+#include "metric_kernels.c"
+
+// Power distance d^2 - w^2
+#define METRIC_NAME power
+#define METRIC_ROW(dy, w) ((dy)*(dy) - (w)*(w))
+#define METRIC_BIAS(w) 0
+#define METRIC_DEPTH(dx, row, bias) ((dx)*(dx) + (row))
+#define METRIC_DEPTH_SSE41(dx, row, bias) _mm_add_epi32(_mm_mullo_epi32(dx, dx), row)
+#define METRIC_DEPTH_AVX2(dx, row, bias) _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), row)
+#define METRIC_DEPTH_AVX512(dx, row, bias) _mm512_add_epi32(_mm512_mullo_epi32(dx, dx), row)
+#include "metric_kernels.c"
+
+// Additively weighted distance d - w, shifted by max_weight to stay
+// non-negative
+#define METRIC_NAME additive
+#define METRIC_ROW(dy, w) ((dy)*(dy))
+#define METRIC_BIAS(w) (max_weight - (w))
+#define METRIC_DEPTH(dx, row, bias) additive_depth((dx)*(dx) + (row), bias)
+#define METRIC_DEPTH_SSE41(dx, row, bias) additive_depth_sse41(_mm_add_epi32(_mm_mullo_epi32(dx, dx), row), bias)
+#define METRIC_DEPTH_AVX2(dx, row, bias) additive_depth_avx2(_mm256_add_epi32(_mm256_mullo_epi32(dx, dx), row), bias)
+#define METRIC_DEPTH_AVX512(dx, row, bias) additive_depth_avx512(_mm512_add_epi32(_mm512_mullo_epi32(dx, dx), row), bias)
+#include "metric_kernels.c"
+
+// Table of the variants of a kernel generated above, indexed by Metric
+#define METRIC_KERNELS(prefix)                  \
+    {                                           \
+        [METRIC_EUCLIDEAN] = prefix##euclidean, \
+        [METRIC_MANHATTAN] = prefix##manhattan, \
+        [METRIC_CHEBYSHEV] = prefix##chebyshev, \
+        [METRIC_MINKOWSKI] = prefix##minkowski, \
+        [METRIC_POWER]     = prefix##power,     \
+        [METRIC_ADDITIVE]  = prefix##additive,  \
+    }
+
+#if defined(SIMD_X86) && LABEL_BITS == 32
+#define APPLY_SEED_ROW_KERNELS(simd) METRIC_KERNELS(apply_seed_row_##simd##_)
+#else
+#define APPLY_SEED_ROW_KERNELS(simd) METRIC_KERNELS(apply_seed_row_scalar_)
+#endif // SIMD_X86 && LABEL_BITS == 32
+
+static void (*const naive_renderers[COUNT_METRICS])(void) = METRIC_KERNELS(render_voronoi_naive_);
+static void (*const grid_renderers[COUNT_METRICS])(void) = METRIC_KERNELS(render_voronoi_grid_);
+static uint32_t (*const seed_grid_nearests[COUNT_METRICS])(int x, int y) = METRIC_KERNELS(seed_grid_nearest_);
+
+void render_voronoi_naive(void)
+{
+    if (metric_max_depth() >= (double)INT64_MAX) {
+        fprintf(stderr, "ERROR: %dx%d canvas does not fit into the 64-bit depth of the %s metric\n",
+                canvas_width, canvas_height, metric_names[metric]);
+        exit(1);
+    }
+    naive_renderers[metric]();
+}
+
+// Converts 0xAABBGGRR pixels into packed RGB bytes
+typedef void (*Pack_Rgb)(const Color32 *pixels, uint8_t *rgb, size_t count);
+
+void pack_rgb_scalar(const Color32 *pixels, uint8_t *rgb, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t pixel = pixels[i];
+        rgb[3*i + 0] = (pixel&0x0000FF)>>8*0;
+        rgb[3*i + 1] = (pixel&0x00FF00)>>8*1;
+        rgb[3*i + 2] = (pixel&0xFF0000)>>8*2;
+    }
+}
+
+#ifdef SIMD_X86
+__attribute__((target("ssse3")))
+void pack_rgb_ssse3(const Color32 *pixels, uint8_t *rgb, size_t count)
+{
+    const __m128i drop_alpha = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    // Each store writes 16 bytes but only 12 of them are meaningful, the
+    // next store overwrites the rest. Stop early enough to stay in bounds.
+    for (; i + 6 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)&pixels[i]);
+        _mm_storeu_si128((__m128i*)&rgb[3*i], _mm_shuffle_epi8(p, drop_alpha));
+    }
+    pack_rgb_scalar(&pixels[i], &rgb[3*i], count - i);
+}
+#endif // SIMD_X86
+
+typedef struct {
+    const char *name;
+    Apply_Seed_Row apply_seed_row[COUNT_METRICS];
+    Pack_Rgb pack_rgb;
+    Kd_Leaf_Scan kd_leaf_scan;
+} Simd_Kernel;
+
+// From the slowest to the fastest
+static Simd_Kernel simd_kernels[] = {
+    {"scalar", APPLY_SEED_ROW_KERNELS(scalar), pack_rgb_scalar, kd_leaf_scan_scalar},
+#ifdef SIMD_X86
+    {"sse4.1", APPLY_SEED_ROW_KERNELS(sse41),  pack_rgb_ssse3,  kd_leaf_scan_sse2},
+    {"avx2",   APPLY_SEED_ROW_KERNELS(avx2),   pack_rgb_ssse3,  kd_leaf_scan_avx2},
+    {"avx512", APPLY_SEED_ROW_KERNELS(avx512), pack_rgb_ssse3,  kd_leaf_scan_avx512},
+#endif // SIMD_X86
+};
+#define simd_kernels_count (sizeof(simd_kernels)/sizeof(simd_kernels[0]))
+
+static Simd_Kernel *simd_kernel = &simd_kernels[0];
+
+bool simd_kernel_supported(const Simd_Kernel *kernel)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(kernel->name, "sse4.1") == 0) return __builtin_cpu_supports("sse4.1");
+    if (strcmp(kernel->name, "avx2") == 0)   return __builtin_cpu_supports("avx2");
+    if (strcmp(kernel->name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+#endif // SIMD_X86
+    return strcmp(kernel->name, "scalar") == 0;
+}
+
+// Picks the fastest kernel the CPU supports, or exactly the requested one
+void simd_select_kernel(const char *name)
 {
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            Point p = {x, y};
-            image[y][x] = point_to_color(p);
+    for (size_t i = simd_kernels_count; i > 0; --i) {
+        Simd_Kernel *kernel = &simd_kernels[i - 1];
+        if (name != NULL && strcmp(name, kernel->name) != 0) continue;
+        if (!simd_kernel_supported(kernel)) {
+            assert(name != NULL);
+            fprintf(stderr, "ERROR: this CPU does not support the %s kernel\n", name);
+            exit(1);
         }
+        simd_kernel = kernel;
+        return;
     }
+    assert(name != NULL);
+    fprintf(stderr, "ERROR: unknown SIMD kernel `%s`\n", name);
+    exit(1);
 }
 
-void apply_next_seed(size_t seed_index)
+typedef enum {
+    IMAGE_FORMAT_PPM = 0,
+    IMAGE_FORMAT_PAM,
+} Image_Format;
+
+// Streams rows of the image into a PPM (P6) or PAM (P7) file. PAM keeps the
+// RGBA bytes of Color32 as they are, so the pixels go out without any
+// conversion. PPM pixels get packed into RGB in big chunks first. Errors
+// are checked once in image_writer_close().
+typedef struct {
+    const char *file_path;
+    FILE *f;
+    Image_Format format;
+    uint8_t *chunk;
+} Image_Writer;
+
+Image_Format image_format_by_path(const char *file_path)
 {
-    Point seed = seeds[seed_index];
-    Color32 color = palette[seed_index%palette_count];
+    size_t n = strlen(file_path);
+    if (n >= 4 && strcmp(file_path + n - 4, ".pam") == 0) return IMAGE_FORMAT_PAM;
+    return IMAGE_FORMAT_PPM;
+}
 
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            int dx = x - seed.x;
-            int dy = y - seed.y;
-            int d = dx*dx + dy*dy;
-            if (d < depth[y][x]) {
-                depth[y][x] = d;
-                image[y][x] = color;
-            }
+void image_writer_open(Image_Writer *w, const char *file_path, int width, int height)
+{
+    w->file_path = file_path;
+    w->format = image_format_by_path(file_path);
+    w->f = fopen(file_path, "wb");
+    if (w->f == NULL) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+
+    switch (w->format) {
+    case IMAGE_FORMAT_PPM:
+        fprintf(w->f, "P6\n%d %d 255\n", width, height);
+        w->chunk = arena_alloc(&arena, 3*WRITE_CHUNK_PIXELS);
+        break;
+    case IMAGE_FORMAT_PAM:
+        fprintf(w->f, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+        w->chunk = NULL;
+        break;
+    default:
+        UNREACHABLE("Unexpected image format");
+    }
+}
+
+void image_writer_write(Image_Writer *w, const Color32 *pixels, size_t count)
+{
+    switch (w->format) {
+    case IMAGE_FORMAT_PPM:
+        for (size_t i = 0; i < count; i += WRITE_CHUNK_PIXELS) {
+            size_t n = count - i < WRITE_CHUNK_PIXELS ? count - i : WRITE_CHUNK_PIXELS;
+            simd_kernel->pack_rgb(&pixels[i], w->chunk, n);
+            fwrite(w->chunk, 3, n, w->f);
+        }
+        break;
+    case IMAGE_FORMAT_PAM:
+        // 0xAABBGGRR is R, G, B, A in memory on little endian
+        fwrite(pixels, sizeof(*pixels), count, w->f);
+        break;
+    default:
+        UNREACHABLE("Unexpected image format");
+    }
+}
+
+// Closes a file that was written with stdio and reports any of the write
+// errors stdio kept to itself
+void close_written_file(FILE *f, const char *file_path)
+{
+    bool failed = ferror(f);
+    int saved_errno = errno;
+    if (fclose(f) != 0) {
+        failed = true;
+        saved_errno = errno;
+    }
+    if (failed) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(saved_errno));
+        exit(1);
+    }
+}
+
+void image_writer_close(Image_Writer *w)
+{
+    close_written_file(w->f, w->file_path);
+}
+
+// The only place that turns labels into colors. Rows [y0, y1) of the labels
+// go through image a few rows at a time, get the seed markers on top and
+// are written into every writer, so one label map serves any number of
+// outputs and palettes.
+void resolve_labels(Image_Writer *writers, size_t writers_count, int y0, int y1,
+                    const Color32 *colors, size_t colors_count)
+{
+    assert(labels_y0 <= y0 && y1 <= labels_y0 + labels_rows);
+    int rows_capacity = image_rows_capacity();
+    for (image_y0 = y0; image_y0 < y1; image_y0 += image_rows) {
+        image_rows = y1 - image_y0 < rows_capacity ? y1 - image_y0 : rows_capacity;
+        size_t n = (size_t)canvas_width*image_rows;
+        const Label *src = &labels[(size_t)(image_y0 - labels_y0)*canvas_width];
+        for (size_t i = 0; i < n; ++i) {
+            image[i] = src[i] == LABEL_NONE ? BACKGROUND_COLOR : colors[src[i]%colors_count];
+        }
+        render_seed_markers();
+        for (size_t k = 0; k < writers_count; ++k) {
+            image_writer_write(&writers[k], image, n);
+        }
+    }
+}
+
+void save_images(const char **file_paths, size_t file_paths_count)
+{
+    Image_Writer writers[MAX_OUTPUTS];
+    assert(file_paths_count <= MAX_OUTPUTS);
+    for (size_t k = 0; k < file_paths_count; ++k) {
+        image_writer_open(&writers[k], file_paths[k], canvas_width, canvas_height);
+    }
+    resolve_labels(writers, file_paths_count, 0, canvas_height, palette, palette_count);
+    for (size_t k = 0; k < file_paths_count; ++k) {
+        image_writer_close(&writers[k]);
+    }
+}
+
+// Thread pool. The caller of pool_run() works as worker 0. Tasks are split
+// into contiguous per-worker ranges up front, and a worker that runs out of
+// its own range steals from the others.
+typedef void (*Task)(void *ctx, size_t task_index, size_t worker_index);
+
+typedef struct {
+    _Alignas(64) atomic_size_t next;
+    size_t end;
+} Task_Queue;
+
+typedef struct {
+    size_t threads_count;
+    pthread_t threads[MAX_THREADS];
+    Task_Queue queues[MAX_THREADS];
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    size_t generation;
+    size_t running;
+
+    Task task;
+    void *ctx;
+} Pool;
+
+static Pool pool = {
+    .threads_count = 1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+void pool_work(size_t worker_index)
+{
+    for (size_t k = 0; k < pool.threads_count; ++k) {
+        Task_Queue *queue = &pool.queues[(worker_index + k)%pool.threads_count];
+        for (;;) {
+            size_t task_index = atomic_fetch_add(&queue->next, 1);
+            if (task_index >= queue->end) break;
+            pool.task(pool.ctx, task_index, worker_index);
+        }
+    }
+}
+
+void *pool_thread(void *arg)
+{
+    size_t worker_index = (size_t) arg;
+    size_t generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.generation == generation) {
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        }
+        generation = pool.generation;
+        pthread_mutex_unlock(&pool.mutex);
+
+        pool_work(worker_index);
+
+        pthread_mutex_lock(&pool.mutex);
+        pool.running -= 1;
+        if (pool.running == 0) pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+    return NULL;
+}
+
+void pool_init(size_t threads_count)
+{
+    if (threads_count == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = n > 0 ? n : 1;
+    }
+    if (threads_count > MAX_THREADS) threads_count = MAX_THREADS;
+
+    pool.threads_count = threads_count;
+    for (size_t i = 1; i < threads_count; ++i) {
+        int ret = pthread_create(&pool.threads[i], NULL, pool_thread, (void*) i);
+        if (ret != 0) {
+            fprintf(stderr, "ERROR: could not create thread: %s\n", strerror(ret));
+            exit(1);
+        }
+    }
+}
+
+void pool_run(Task task, void *ctx, size_t tasks_count)
+{
+    size_t n = pool.threads_count;
+    for (size_t i = 0; i < n; ++i) {
+        atomic_store(&pool.queues[i].next, tasks_count*i/n);
+        pool.queues[i].end = tasks_count*(i + 1)/n;
+    }
+    pool.task = task;
+    pool.ctx = ctx;
+
+    if (n > 1) {
+        pthread_mutex_lock(&pool.mutex);
+        pool.running = n - 1;
+        pool.generation += 1;
+        pthread_cond_broadcast(&pool.start);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    pool_work(0);
+
+    if (n > 1) {
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.running > 0) {
+            pthread_cond_wait(&pool.done, &pool.mutex);
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+}
+
+typedef struct {
+    int x0, y0, x1, y1;
+} Tile;
+
+Tile tile_by_index(size_t index)
+{
+    int cols = (canvas_width + TILE_SIZE - 1)/TILE_SIZE;
+    Tile tile;
+    tile.x0 = index%cols*TILE_SIZE;
+    tile.y0 = index/cols*TILE_SIZE;
+    tile.x1 = tile.x0 + TILE_SIZE < canvas_width ? tile.x0 + TILE_SIZE : canvas_width;
+    tile.y1 = tile.y0 + TILE_SIZE < canvas_height ? tile.y0 + TILE_SIZE : canvas_height;
+    return tile;
+}
+
+size_t tile_index_of(int x, int y)
+{
+    int cols = (canvas_width + TILE_SIZE - 1)/TILE_SIZE;
+    return (size_t)(y/TILE_SIZE)*cols + x/TILE_SIZE;
+}
+
+size_t tiles_count(void)
+{
+    return (size_t)((canvas_width + TILE_SIZE - 1)/TILE_SIZE)*((canvas_height + TILE_SIZE - 1)/TILE_SIZE);
+}
+
+void render_voronoi_interesting_tile(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    Tile tile = tile_by_index(task_index);
+    int *depth = &tile_depths[worker_index*TILE_SIZE*TILE_SIZE];
+    int width = tile.x1 - tile.x0;
+    Apply_Seed_Row apply_seed_row = simd_kernel->apply_seed_row[metric];
+
+    for (int i = 0; i < TILE_SIZE*TILE_SIZE; ++i) {
+        depth[i] = INT_MAX;
+    }
+
+    for (size_t i = 0; i < seeds_count; ++i) {
+        Point seed = seeds[i];
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            apply_seed_row(&depth[(y - tile.y0)*TILE_SIZE], &labels[(size_t)y*canvas_width + tile.x0],
+                           width, tile.x0 - seed.x, y - seed.y, seed_weights[i], i);
         }
     }
 }
 
+// Same as applying every seed to the whole image one after another with a
+// depth buffer, but each tile gets all the seeds while it is still hot in
+// the cache, and so only the tiles in flight need depth.
 void render_voronoi_interesting(void)
 {
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            depth[y][x] = INT_MAX;
+    if (metric_max_depth() >= INT_MAX) {
+        fprintf(stderr, "ERROR: %dx%d canvas does not fit into the 32-bit depth buffer of the interesting engine with the %s metric, try another engine\n",
+                canvas_width, canvas_height, metric_names[metric]);
+        exit(1);
+    }
+    tile_depths = arena_alloc(&arena, pool.threads_count*TILE_SIZE*TILE_SIZE*sizeof(*tile_depths));
+    pool_run(render_voronoi_interesting_tile, NULL, tiles_count());
+}
+
+// Jump Flooding: every pixel keeps the index of the closest seed it has
+// heard about so far and on each pass looks at its 8 neighbours `step`
+// pixels away. log2(max(canvas_width, canvas_height)) passes, independent
+// of seeds_count. The result is approximate, see --compare.
+void render_voronoi_jfa(void)
+{
+    jfa_buffers[0] = arena_alloc(&arena, pixels_count()*sizeof(*jfa_buffers[0]));
+    jfa_buffers[1] = arena_alloc(&arena, pixels_count()*sizeof(*jfa_buffers[1]));
+    uint32_t *src = jfa_buffers[0];
+    uint32_t *dst = jfa_buffers[1];
+
+    size_t n = pixels_count();
+    for (size_t i = 0; i < n; ++i) {
+        src[i] = JFA_EMPTY;
+    }
+
+    // Going backwards so the smallest index wins on duplicate seeds, just
+    // like in render_voronoi_naive()
+    for (size_t i = seeds_count; i > 0; --i) {
+        src[(size_t)seeds[i - 1].y*canvas_width + seeds[i - 1].x] = i - 1;
+    }
+
+    int size = canvas_width > canvas_height ? canvas_width : canvas_height;
+    int step = 1;
+    while (step < size) step *= 2;
+
+    for (step /= 2; step > 0; step /= 2) {
+        for (int y = 0; y < canvas_height; ++y) {
+            for (int x = 0; x < canvas_width; ++x) {
+                uint32_t best = src[(size_t)y*canvas_width + x];
+                int64_t best_dist = best == JFA_EMPTY ? INT64_MAX : sqr_dist(seeds[best].x, seeds[best].y, x, y);
+                for (int dy = -step; dy <= step; dy += step) {
+                    int ny = y + dy;
+                    if (ny < 0 || ny >= canvas_height) continue;
+                    for (int dx = -step; dx <= step; dx += step) {
+                        int nx = x + dx;
+                        if (nx < 0 || nx >= canvas_width) continue;
+                        uint32_t candidate = src[(size_t)ny*canvas_width + nx];
+                        if (candidate == JFA_EMPTY || candidate == best) continue;
+                        int64_t d = sqr_dist(seeds[candidate].x, seeds[candidate].y, x, y);
+                        if (d < best_dist || (d == best_dist && candidate < best)) {
+                            best = candidate;
+                            best_dist = d;
+                        }
+                    }
+                }
+                dst[(size_t)y*canvas_width + x] = best;
+            }
         }
+
+        uint32_t *t = src;
+        src = dst;
+        dst = t;
     }
 
-    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
-        apply_next_seed(i);
+    for (size_t i = 0; i < n; ++i) {
+        labels[i] = src[i];
     }
 }
 
-int main(void)
+void build_seed_grid(void)
 {
-    srand(time(0));
-    fill_image(BACKGROUND_COLOR);
-    generate_random_seeds();
-    render_voronoi_interesting();
-    render_seed_markers();
-    save_image_as_ppm(OUTPUT_FILE_PATH);
+    // Roughly 2 seeds per cell
+    grid_cell_size = ceil_sqrt(((size_t)canvas_width*canvas_height*2 + seeds_count - 1)/seeds_count);
+    if (grid_cell_size < 1) grid_cell_size = 1;
+    grid_cols = (canvas_width + grid_cell_size - 1)/grid_cell_size;
+    grid_rows = (canvas_height + grid_cell_size - 1)/grid_cell_size;
+
+    size_t cells_count = (size_t)grid_cols*grid_rows;
+    grid_cells = arena_alloc(&arena, (cells_count + 1)*sizeof(*grid_cells));
+    grid_seeds = arena_alloc(&arena, seeds_count*sizeof(*grid_seeds));
+    memset(grid_cells, 0, sizeof(grid_cells[0])*(cells_count + 1));
+    for (size_t i = 0; i < seeds_count; ++i) {
+        size_t cell = (size_t)(seeds[i].y/grid_cell_size)*grid_cols + seeds[i].x/grid_cell_size;
+        grid_cells[cell + 1] += 1;
+    }
+    for (size_t i = 0; i < cells_count; ++i) {
+        grid_cells[i + 1] += grid_cells[i];
+    }
+    // Counting sort, so the seeds of each cell stay in increasing index order
+    for (size_t i = 0; i < seeds_count; ++i) {
+        size_t cell = (size_t)(seeds[i].y/grid_cell_size)*grid_cols + seeds[i].x/grid_cell_size;
+        grid_seeds[grid_cells[cell]++] = i;
+    }
+    for (size_t i = cells_count; i > 0; --i) {
+        grid_cells[i] = grid_cells[i - 1];
+    }
+    grid_cells[0] = 0;
+}
+
+void render_voronoi_grid(void)
+{
+    build_seed_grid();
+    grid_renderers[metric]();
+}
+
+typedef struct {
+    _Alignas(64) size_t exact_pixels;
+    size_t filled_pixels;
+    size_t queries;
+} Quadtree_Stats;
+
+static Quadtree_Stats quadtree_stats[MAX_THREADS];
+
+Label quadtree_nearest(int x, int y, Quadtree_Stats *stats)
+{
+    stats->queries += 1;
+    return seed_grid_nearests[metric](x, y);
+}
+
+// Cells are convex, even with the smallest index winning ties, because each
+// one is an intersection of half-planes. So if all four corners of a block
+// belong to the same seed the whole block does and it gets filled without
+// looking at its pixels. Otherwise the block is split in four, down to
+// blocks whose corners are all of their pixels. Corners the block shares
+// with its parent come from the parent, LABEL_NONE means unknown.
+void quadtree_refine(int x0, int y0, int x1, int y1, Label c00, Label c10, Label c01, Label c11, Quadtree_Stats *stats)
+{
+    if (c00 == LABEL_NONE) c00 = quadtree_nearest(x0, y0, stats);
+    if (c10 == LABEL_NONE) c10 = quadtree_nearest(x1 - 1, y0, stats);
+    if (c01 == LABEL_NONE) c01 = quadtree_nearest(x0, y1 - 1, stats);
+    if (c11 == LABEL_NONE) c11 = quadtree_nearest(x1 - 1, y1 - 1, stats);
+    size_t area = (size_t)(x1 - x0)*(y1 - y0);
+
+    if (c00 == c10 && c00 == c01 && c00 == c11) {
+        for (int y = y0; y < y1; ++y) {
+            fill_row(&labels[(size_t)y*canvas_width + x0], x1 - x0, c00);
+        }
+        stats->filled_pixels += area;
+        return;
+    }
+
+    if (x1 - x0 <= 2 && y1 - y0 <= 2) {
+        labels[(size_t)y0*canvas_width + x0] = c00;
+        labels[(size_t)y0*canvas_width + x1 - 1] = c10;
+        labels[(size_t)(y1 - 1)*canvas_width + x0] = c01;
+        labels[(size_t)(y1 - 1)*canvas_width + x1 - 1] = c11;
+        stats->exact_pixels += area;
+        return;
+    }
+
+    int xm = x1 - x0 > 2 ? x0 + (x1 - x0)/2 : x1;
+    int ym = y1 - y0 > 2 ? y0 + (y1 - y0)/2 : y1;
+    Label none = LABEL_NONE;
+    quadtree_refine(x0, y0, xm, ym, c00, xm == x1 ? c10 : none, ym == y1 ? c01 : none, xm == x1 && ym == y1 ? c11 : none, stats);
+    if (xm < x1) quadtree_refine(xm, y0, x1, ym, none, c10, none, ym == y1 ? c11 : none, stats);
+    if (ym < y1) quadtree_refine(x0, ym, xm, y1, none, none, c01, xm == x1 ? c11 : none, stats);
+    if (xm < x1 && ym < y1) quadtree_refine(xm, ym, x1, y1, none, none, none, c11, stats);
+}
+
+void render_voronoi_quadtree_tile(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    Tile tile = tile_by_index(task_index);
+    quadtree_refine(tile.x0, tile.y0, tile.x1, tile.y1, LABEL_NONE, LABEL_NONE, LABEL_NONE, LABEL_NONE, &quadtree_stats[worker_index]);
+}
+
+void render_voronoi_quadtree(void)
+{
+    build_seed_grid();
+    memset(quadtree_stats, 0, sizeof(quadtree_stats));
+    pool_run(render_voronoi_quadtree_tile, NULL, tiles_count());
+
+    Quadtree_Stats total = {0};
+    for (size_t i = 0; i < pool.threads_count; ++i) {
+        total.exact_pixels += quadtree_stats[i].exact_pixels;
+        total.filled_pixels += quadtree_stats[i].filled_pixels;
+        total.queries += quadtree_stats[i].queries;
+    }
+    printf("INFO: quadtree resolved %zu pixels exactly and block-filled %zu (%.1f%%) with %zu nearest seed queries\n",
+           total.exact_pixels, total.filled_pixels, 100.0*total.filled_pixels/pixels_count(), total.queries);
+}
+
+#define KD_QUERY_TASK_SIZE 1024
+
+static Kd_Tree seed_kd_tree;
+
+typedef struct {
+    const double *xs;
+    const double *ys;
+    size_t count;
+    uint32_t *indices;
+    double *distances;
+} Nearest_Seeds_Batch;
+
+// Has to be called again after the seeds change. The leaf scans follow
+// --simd.
+void build_seed_kd_tree(void)
+{
+    size_t mark = arena.size;
+    double *xs = arena_alloc(&arena, seeds_count*sizeof(*xs));
+    double *ys = arena_alloc(&arena, seeds_count*sizeof(*ys));
+    for (size_t i = 0; i < seeds_count; ++i) {
+        xs[i] = seeds[i].x;
+        ys[i] = seeds[i].y;
+    }
+    kd_tree_build(&seed_kd_tree, xs, ys, seeds_count, simd_kernel->kd_leaf_scan);
+    arena.size = mark;
+}
+
+void nearest_seeds_task(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) worker_index;
+    Nearest_Seeds_Batch *batch = ctx;
+    size_t i = task_index*KD_QUERY_TASK_SIZE;
+    size_t n = batch->count - i < KD_QUERY_TASK_SIZE ? batch->count - i : KD_QUERY_TASK_SIZE;
+    double *distances = batch->distances != NULL ? &batch->distances[i] : NULL;
+    kd_tree_nearest_batch(&seed_kd_tree, &batch->xs[i], &batch->ys[i], n, &batch->indices[i], distances);
+    if (distances != NULL) {
+        for (size_t j = 0; j < n; ++j) {
+            distances[j] = sqrt(distances[j]);
+        }
+    }
+}
+
+// Index of the closest seed to every one of the points (xs[i], ys[i]) and
+// the distance to it, the same seed render_voronoi_naive() picks for
+// integer points. distances may be NULL. Runs on all threads of the pool.
+void nearest_seeds(const double *xs, const double *ys, size_t count, uint32_t *indices, double *distances)
+{
+    Nearest_Seeds_Batch batch = {xs, ys, count, indices, distances};
+    pool_run(nearest_seeds_task, &batch, (count + KD_QUERY_TASK_SIZE - 1)/KD_QUERY_TASK_SIZE);
+}
+
+// Every pixel is a nearest_seeds() query, a chunk of rows at a time
+void render_voronoi_kdtree(void)
+{
+    build_seed_kd_tree();
+
+    int rows = image_rows_capacity();
+    size_t chunk = (size_t)canvas_width*rows;
+    double *xs = arena_alloc(&arena, chunk*sizeof(*xs));
+    double *ys = arena_alloc(&arena, chunk*sizeof(*ys));
+    uint32_t *indices = arena_alloc(&arena, chunk*sizeof(*indices));
+
+    double query_secs = 0;
+    for (int y0 = 0; y0 < canvas_height; y0 += rows) {
+        int y1 = y0 + rows < canvas_height ? y0 + rows : canvas_height;
+        size_t n = (size_t)canvas_width*(y1 - y0);
+        for (int y = y0; y < y1; ++y) {
+            for (int x = 0; x < canvas_width; ++x) {
+                xs[(size_t)(y - y0)*canvas_width + x] = x;
+                ys[(size_t)(y - y0)*canvas_width + x] = y;
+            }
+        }
+
+        double start = get_secs();
+        nearest_seeds(xs, ys, n, indices, NULL);
+        query_secs += get_secs() - start;
+
+        Label *row = &labels[(size_t)y0*canvas_width];
+        for (size_t i = 0; i < n; ++i) {
+            row[i] = indices[i];
+        }
+    }
+    printf("INFO: kdtree answered %zu nearest seed queries, %.1fM per second\n",
+           pixels_count(), pixels_count()/query_secs*1e-6);
+}
+
+#define da_append(da, item)                                                          \
+    do {                                                                             \
+        if ((da)->count >= (da)->capacity) {                                         \
+            (da)->capacity = (da)->capacity == 0 ? 256 : (da)->capacity*2;           \
+            (da)->items = realloc((da)->items, (da)->capacity*sizeof(*(da)->items)); \
+            assert((da)->items != NULL && "Buy more RAM lol");                       \
+        }                                                                            \
+        (da)->items[(da)->count++] = (item);                                         \
+    } while (0)
+
+// Exact Voronoi diagram of the seeds built with Fortune's sweep line.
+//
+// The sweep only figures out which cells are neighbours. The cell polygons
+// are then the canvas rectangle clipped by the bisectors with those
+// neighbours, which is a lot more forgiving to the degenerate cases integer
+// seeds are full of (equal y, cocircular seeds) than tracking the half-edges
+// of the sweep itself.
+
+#define NIL UINT32_MAX
+
+typedef struct {
+    double x, y;
+} Vertex;
+
+typedef struct {
+    uint32_t seeds[2];  // cells on both sides of a -> b
+    Vertex a, b;
+} Voronoi_Edge;
+
+typedef struct {
+    Vertex *items;
+    size_t count;
+    size_t capacity;
+} Vertices;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Indices;
+
+typedef struct {
+    Voronoi_Edge *items;
+    size_t count;
+    size_t capacity;
+} Voronoi_Edges;
+
+typedef struct {
+    // Polygon of seed i is vertices[cells[i]..cells[i + 1]] in clockwise
+    // order on the screen. sides[k] is the seed on the other side of the
+    // edge from vertices[k] to the next vertex, NIL for the canvas border.
+    // Duplicate seeds get empty polygons, their smallest index owns the cell.
+    size_t *cells;
+    Vertices vertices;
+    Indices sides;
+
+    // Neighbours of seed i are neighbors.items[neighbors_start[i]..neighbors_start[i + 1]]
+    size_t *neighbors_start;
+    Indices neighbors;
+
+    // Every edge between two cells once, the canvas border is left out
+    Voronoi_Edges edges;
+} Voronoi_Diagram;
+
+static Voronoi_Diagram diagram;
+
+typedef struct {
+    uint32_t site;
+    uint32_t prev, next;           // along the beach line
+    uint32_t parent, left, right;  // treap over the beach line
+    uint32_t priority;
+    uint32_t event;
+} Arc;
+
+typedef struct {
+    Arc *items;
+    size_t count;
+    size_t capacity;
+} Arcs;
+
+typedef struct {
+    double x, y;
+    uint32_t arc;
+    bool valid;
+} Circle_Event;
+
+typedef struct {
+    Circle_Event *items;
+    size_t count;
+    size_t capacity;
+} Circle_Events;
+
+typedef struct {
+    uint32_t a, b;
+} Index_Pair;
+
+typedef struct {
+    Index_Pair *items;
+    size_t count;
+    size_t capacity;
+} Index_Pairs;
+
+typedef struct {
+    Arcs arcs;
+    uint32_t root;
+    Circle_Events events;
+    Indices heap;
+    Index_Pairs adjacent;
+    uint32_t rng;
+} Fortune;
+
+static Fortune fortune;
+
+// x where the arcs of seeds p (left) and q (right) meet when the sweep line is at y = l
+double fortune_breakpoint(Point p, Point q, double l)
+{
+    if (p.y == q.y) return (p.x + q.x)*0.5;
+    if (p.y == l) return p.x;
+    if (q.y == l) return q.x;
+    double dp = 2.0*(p.y - l);
+    double dq = 2.0*(q.y - l);
+    double a = 1.0/dp - 1.0/dq;
+    double b = 2.0*(q.x/dq - p.x/dp);
+    double c = ((double)p.x*p.x + (double)p.y*p.y - l*l)/dp - ((double)q.x*q.x + (double)q.y*q.y - l*l)/dq;
+    double disc = b*b - 4.0*a*c;
+    if (disc < 0.0) disc = 0.0;
+    return (-b - sqrt(disc))/(2.0*a);
+}
+
+void fortune_rotate_up(uint32_t n)
+{
+    Arc *arcs = fortune.arcs.items;
+    uint32_t p = arcs[n].parent;
+    uint32_t g = arcs[p].parent;
+    if (arcs[p].left == n) {
+        arcs[p].left = arcs[n].right;
+        if (arcs[n].right != NIL) arcs[arcs[n].right].parent = p;
+        arcs[n].right = p;
+    } else {
+        arcs[p].right = arcs[n].left;
+        if (arcs[n].left != NIL) arcs[arcs[n].left].parent = p;
+        arcs[n].left = p;
+    }
+    arcs[p].parent = n;
+    arcs[n].parent = g;
+    if (g == NIL) {
+        fortune.root = n;
+    } else if (arcs[g].left == p) {
+        arcs[g].left = n;
+    } else {
+        arcs[g].right = n;
+    }
+}
+
+uint32_t fortune_new_arc(uint32_t site)
+{
+    // xorshift32
+    fortune.rng ^= fortune.rng << 13;
+    fortune.rng ^= fortune.rng >> 17;
+    fortune.rng ^= fortune.rng << 5;
+    Arc arc = {
+        .site = site,
+        .prev = NIL, .next = NIL,
+        .parent = NIL, .left = NIL, .right = NIL,
+        .priority = fortune.rng,
+        .event = NIL,
+    };
+    da_append(&fortune.arcs, arc);
+    return fortune.arcs.count - 1;
+}
+
+// Puts n right after a on the beach line, or makes it the whole beach line if a is NIL
+void fortune_insert_after(uint32_t a, uint32_t n)
+{
+    Arc *arcs = fortune.arcs.items;
+    if (a == NIL) {
+        assert(fortune.root == NIL);
+        fortune.root = n;
+        return;
+    }
+
+    arcs[n].prev = a;
+    arcs[n].next = arcs[a].next;
+    if (arcs[a].next != NIL) arcs[arcs[a].next].prev = n;
+    arcs[a].next = n;
+
+    if (arcs[a].right == NIL) {
+        arcs[a].right = n;
+        arcs[n].parent = a;
+    } else {
+        // The successor of a has no left child
+        uint32_t s = arcs[n].next;
+        assert(arcs[s].left == NIL);
+        arcs[s].left = n;
+        arcs[n].parent = s;
+    }
+
+    while (arcs[n].parent != NIL && arcs[arcs[n].parent].priority < arcs[n].priority) {
+        fortune_rotate_up(n);
+    }
+}
+
+void fortune_remove(uint32_t n)
+{
+    Arc *arcs = fortune.arcs.items;
+    if (arcs[n].prev != NIL) arcs[arcs[n].prev].next = arcs[n].next;
+    if (arcs[n].next != NIL) arcs[arcs[n].next].prev = arcs[n].prev;
+
+    while (arcs[n].left != NIL && arcs[n].right != NIL) {
+        uint32_t l = arcs[n].left;
+        uint32_t r = arcs[n].right;
+        fortune_rotate_up(arcs[l].priority > arcs[r].priority ? l : r);
+    }
+
+    uint32_t child = arcs[n].left != NIL ? arcs[n].left : arcs[n].right;
+    uint32_t p = arcs[n].parent;
+    if (child != NIL) arcs[child].parent = p;
+    if (p == NIL) {
+        fortune.root = child;
+    } else if (arcs[p].left == n) {
+        arcs[p].left = child;
+    } else {
+        arcs[p].right = child;
+    }
+}
+
+uint32_t fortune_arc_above(Point site)
+{
+    Arc *arcs = fortune.arcs.items;
+    uint32_t n = fortune.root;
+    for (;;) {
+        Arc *arc = &arcs[n];
+        if (arc->prev != NIL && arc->left != NIL &&
+            site.x < fortune_breakpoint(seeds[arcs[arc->prev].site], seeds[arc->site], site.y)) {
+            n = arc->left;
+        } else if (arc->next != NIL && arc->right != NIL &&
+                   site.x > fortune_breakpoint(seeds[arc->site], seeds[arcs[arc->next].site], site.y)) {
+            n = arc->right;
+        } else {
+            return n;
+        }
+    }
+}
+
+bool fortune_event_less(uint32_t a, uint32_t b)
+{
+    Circle_Event *ea = &fortune.events.items[a];
+    Circle_Event *eb = &fortune.events.items[b];
+    return ea->y < eb->y || (ea->y == eb->y && ea->x < eb->x);
+}
+
+void fortune_push_event(uint32_t event)
+{
+    da_append(&fortune.heap, event);
+    uint32_t *heap = fortune.heap.items;
+    size_t i = fortune.heap.count - 1;
+    while (i > 0 && fortune_event_less(heap[i], heap[(i - 1)/2])) {
+        uint32_t t = heap[i];
+        heap[i] = heap[(i - 1)/2];
+        heap[(i - 1)/2] = t;
+        i = (i - 1)/2;
+    }
+}
+
+uint32_t fortune_pop_event(void)
+{
+    uint32_t *heap = fortune.heap.items;
+    uint32_t top = heap[0];
+    heap[0] = heap[--fortune.heap.count];
+    size_t i = 0;
+    for (;;) {
+        size_t l = 2*i + 1;
+        size_t r = 2*i + 2;
+        size_t m = i;
+        if (l < fortune.heap.count && fortune_event_less(heap[l], heap[m])) m = l;
+        if (r < fortune.heap.count && fortune_event_less(heap[r], heap[m])) m = r;
+        if (m == i) break;
+        uint32_t t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+    return top;
+}
+
+void fortune_invalidate_event(uint32_t arc)
+{
+    Arc *a = &fortune.arcs.items[arc];
+    if (a->event != NIL) {
+        fortune.events.items[a->event].valid = false;
+        a->event = NIL;
+    }
+}
+
+// Schedules the moment the arc gets squeezed out by its neighbours, if ever
+void fortune_check_circle(uint32_t arc)
+{
+    Arc *arcs = fortune.arcs.items;
+    uint32_t l = arcs[arc].prev;
+    uint32_t r = arcs[arc].next;
+    if (l == NIL || r == NIL) return;
+    if (arcs[l].site == arcs[r].site) return;
+
+    Point a = seeds[arcs[l].site];
+    Point b = seeds[arcs[arc].site];
+    Point c = seeds[arcs[r].site];
+    int64_t bx = b.x - a.x, by = b.y - a.y;
+    int64_t cx = c.x - a.x, cy = c.y - a.y;
+    int64_t cross = bx*cy - by*cx;
+    // The breakpoints only converge when the sites turn this way
+    if (cross <= 0) return;
+
+    double d = 2.0*(double)cross;
+    double b2 = (double)(bx*bx + by*by);
+    double c2 = (double)(cx*cx + cy*cy);
+    double ux = (cy*b2 - by*c2)/d;
+    double uy = (bx*c2 - cx*b2)/d;
+
+    Circle_Event event = {
+        .x = a.x + ux,
+        .y = a.y + uy + sqrt(ux*ux + uy*uy),
+        .arc = arc,
+        .valid = true,
+    };
+    da_append(&fortune.events, event);
+    arcs[arc].event = fortune.events.count - 1;
+    fortune_push_event(arcs[arc].event);
+}
+
+void fortune_add_adjacent(uint32_t a, uint32_t b)
+{
+    Index_Pair pair = {a < b ? a : b, a < b ? b : a};
+    da_append(&fortune.adjacent, pair);
+}
+
+void fortune_site_event(uint32_t site)
+{
+    uint32_t n = fortune_new_arc(site);
+    if (fortune.root == NIL) {
+        fortune_insert_after(NIL, n);
+        return;
+    }
+
+    uint32_t a = fortune_arc_above(seeds[site]);
+    uint32_t above = fortune.arcs.items[a].site;
+    fortune_invalidate_event(a);
+    fortune_add_adjacent(above, site);
+
+    if (seeds[above].y == seeds[site].y) {
+        // Only happens for the very first row of seeds, they come sorted by x
+        // and their arcs are still vertical rays
+        fortune_insert_after(a, n);
+        fortune_check_circle(a);
+        return;
+    }
+
+    uint32_t split = fortune_new_arc(above);
+    fortune_insert_after(a, n);
+    fortune_insert_after(n, split);
+    fortune_check_circle(a);
+    fortune_check_circle(split);
+}
+
+void fortune_circle_event(uint32_t event)
+{
+    uint32_t arc = fortune.events.items[event].arc;
+    Arc *arcs = fortune.arcs.items;
+    uint32_t l = arcs[arc].prev;
+    uint32_t r = arcs[arc].next;
+    arcs[arc].event = NIL;
+
+    fortune_add_adjacent(arcs[l].site, arcs[r].site);
+    fortune_remove(arc);
+    fortune_invalidate_event(l);
+    fortune_invalidate_event(r);
+    fortune_check_circle(l);
+    fortune_check_circle(r);
+}
+
+int compare_pairs(const void *a, const void *b)
+{
+    const Index_Pair *p = a;
+    const Index_Pair *q = b;
+    if (p->a != q->a) return p->a < q->a ? -1 : 1;
+    if (p->b != q->b) return p->b < q->b ? -1 : 1;
+    return 0;
+}
+
+static uint32_t *sweep_order;
+static bool *seed_is_duplicate;
+
+int compare_sweep_order(const void *a, const void *b)
+{
+    uint32_t i = *(const uint32_t*)a;
+    uint32_t j = *(const uint32_t*)b;
+    if (seeds[i].y != seeds[j].y) return seeds[i].y < seeds[j].y ? -1 : 1;
+    if (seeds[i].x != seeds[j].x) return seeds[i].x < seeds[j].x ? -1 : 1;
+    return i < j ? -1 : i > j;
+}
+
+// Sutherland-Hodgman against the half-plane of points at least as close to
+// seed i as to seed j. The polygon is at the end of vs/sides starting at
+// *start, the result gets appended right after it and *start moves there.
+void clip_cell_by_bisector(Vertices *vs, Indices *sides, size_t *start, uint32_t i, uint32_t j)
+{
+    Point si = seeds[i];
+    Point sj = seeds[j];
+    double nx = sj.x - si.x;
+    double ny = sj.y - si.y;
+    double k = ((double)sj.x*sj.x + (double)sj.y*sj.y - (double)si.x*si.x - (double)si.y*si.y)*0.5;
+
+    size_t n = vs->count - *start;
+    size_t out = vs->count;
+    for (size_t m = 0; m < n; ++m) {
+        Vertex p = vs->items[*start + m];
+        Vertex q = vs->items[*start + (m + 1)%n];
+        uint32_t side = sides->items[*start + m];
+        double dp = p.x*nx + p.y*ny - k;
+        double dq = q.x*nx + q.y*ny - k;
+        if (dp <= 0) {
+            da_append(vs, p);
+            da_append(sides, side);
+        }
+        if ((dp < 0 && dq > 0) || (dp > 0 && dq < 0)) {
+            double t = dp/(dp - dq);
+            Vertex v = {p.x + (q.x - p.x)*t, p.y + (q.y - p.y)*t};
+            da_append(vs, v);
+            da_append(sides, dp < 0 ? j : side);
+        }
+    }
+    *start = out;
+}
+
+int64_t floor_div(int64_t a, int64_t b)
+{
+    assert(b > 0);
+    return a >= 0 ? a/b : -((-a + b - 1)/b);
+}
+
+// Only the neighbours of every seed, the polygons are left to
+// build_voronoi_diagram() or clip_voronoi_cell()
+void build_voronoi_neighbors(Voronoi_Diagram *vd)
+{
+    fortune.arcs.count = 0;
+    fortune.events.count = 0;
+    fortune.heap.count = 0;
+    fortune.adjacent.count = 0;
+    fortune.root = NIL;
+    fortune.rng = 0x9E3779B9;
+
+    sweep_order = arena_alloc(&arena, seeds_count*sizeof(*sweep_order));
+    seed_is_duplicate = arena_alloc(&arena, seeds_count*sizeof(*seed_is_duplicate));
+    vd->cells = arena_alloc(&arena, (seeds_count + 1)*sizeof(*vd->cells));
+    vd->neighbors_start = arena_alloc(&arena, (seeds_count + 1)*sizeof(*vd->neighbors_start));
+
+    for (size_t i = 0; i < seeds_count; ++i) sweep_order[i] = i;
+    qsort(sweep_order, seeds_count, sizeof(sweep_order[0]), compare_sweep_order);
+
+    size_t next_site = 0;
+    while (next_site < seeds_count || fortune.heap.count > 0) {
+        bool site_first = next_site < seeds_count;
+        if (site_first && fortune.heap.count > 0) {
+            Circle_Event *top = &fortune.events.items[fortune.heap.items[0]];
+            Point site = seeds[sweep_order[next_site]];
+            site_first = site.y < top->y || (site.y == top->y && site.x < top->x);
+        }
+
+        if (site_first) {
+            uint32_t site = sweep_order[next_site++];
+            // Duplicates come right after the smallest index at the same position
+            seed_is_duplicate[site] = false;
+            if (next_site >= 2) {
+                Point prev = seeds[sweep_order[next_site - 2]];
+                seed_is_duplicate[site] = prev.x == seeds[site].x && prev.y == seeds[site].y;
+            }
+            if (!seed_is_duplicate[site]) fortune_site_event(site);
+        } else {
+            uint32_t event = fortune_pop_event();
+            if (fortune.events.items[event].valid) fortune_circle_event(event);
+        }
+    }
+
+    // A single seed, or nothing but duplicates, leaves no pairs and no items
+    if (fortune.adjacent.count > 0) {
+        qsort(fortune.adjacent.items, fortune.adjacent.count, sizeof(fortune.adjacent.items[0]), compare_pairs);
+    }
+
+    memset(vd->neighbors_start, 0, (seeds_count + 1)*sizeof(*vd->neighbors_start));
+    size_t unique = 0;
+    for (size_t k = 0; k < fortune.adjacent.count; ++k) {
+        Index_Pair pair = fortune.adjacent.items[k];
+        if (unique > 0 && compare_pairs(&fortune.adjacent.items[unique - 1], &pair) == 0) continue;
+        fortune.adjacent.items[unique++] = pair;
+        vd->neighbors_start[pair.a + 1] += 1;
+        vd->neighbors_start[pair.b + 1] += 1;
+    }
+    fortune.adjacent.count = unique;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        vd->neighbors_start[i + 1] += vd->neighbors_start[i];
+    }
+
+    vd->neighbors.count = 0;
+    for (size_t k = 0; k < vd->neighbors_start[seeds_count]; ++k) da_append(&vd->neighbors, 0);
+    for (size_t k = 0; k < fortune.adjacent.count; ++k) {
+        Index_Pair pair = fortune.adjacent.items[k];
+        vd->neighbors.items[vd->neighbors_start[pair.a]++] = pair.b;
+        vd->neighbors.items[vd->neighbors_start[pair.b]++] = pair.a;
+    }
+    for (size_t i = seeds_count; i > 0; --i) {
+        vd->neighbors_start[i] = vd->neighbors_start[i - 1];
+    }
+    vd->neighbors_start[0] = 0;
+}
+
+// Appends the polygon of seed i to the end of vs and sides, in the same
+// shape as the cells of Voronoi_Diagram. Returns how many vertices it has,
+// 0 for duplicates. Seeds and pixels sit at integer points, so the canvas
+// reaches half a pixel past the outermost ones.
+size_t clip_voronoi_cell(const Voronoi_Diagram *vd, uint32_t i, Vertices *vs, Indices *sides)
+{
+    if (seed_is_duplicate[i]) return 0;
+
+    size_t cell = vs->count;
+    double x0 = -0.5, y0 = -0.5;
+    double x1 = canvas_width - 0.5, y1 = canvas_height - 0.5;
+    Vertex corners[4] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+    for (size_t k = 0; k < 4; ++k) {
+        da_append(vs, corners[k]);
+        da_append(sides, NIL);
+    }
+
+    size_t start = cell;
+    for (size_t k = vd->neighbors_start[i]; k < vd->neighbors_start[i + 1]; ++k) {
+        clip_cell_by_bisector(vs, sides, &start, i, vd->neighbors.items[k]);
+    }
+
+    size_t count = vs->count - start;
+    memmove(&vs->items[cell], &vs->items[start], count*sizeof(vs->items[0]));
+    memmove(&sides->items[cell], &sides->items[start], count*sizeof(sides->items[0]));
+    vs->count = cell + count;
+    sides->count = cell + count;
+    return count;
+}
+
+void build_voronoi_diagram(Voronoi_Diagram *vd)
+{
+    build_voronoi_neighbors(vd);
+
+    vd->vertices.count = 0;
+    vd->sides.count = 0;
+    vd->edges.count = 0;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        size_t cell = vd->vertices.count;
+        vd->cells[i] = cell;
+        size_t count = clip_voronoi_cell(vd, i, &vd->vertices, &vd->sides);
+
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t j = vd->sides.items[cell + k];
+            if (j != NIL && j > i) {
+                Voronoi_Edge edge = {
+                    .seeds = {i, j},
+                    .a = vd->vertices.items[cell + k],
+                    .b = vd->vertices.items[cell + (k + 1)%count],
+                };
+                da_append(&vd->edges, edge);
+            }
+        }
+    }
+    vd->cells[seeds_count] = vd->vertices.count;
+}
+
+// Pixels [*x0, *x1] of row y that seed i wins against all of its neighbours,
+// with the same tie breaking as render_voronoi_naive(). Exact, no floats.
+bool voronoi_cell_row_span(const Voronoi_Diagram *vd, uint32_t i, int y, int *x0, int *x1)
+{
+    int64_t lo = 0;
+    int64_t hi = canvas_width - 1;
+    Point si = seeds[i];
+    for (size_t k = vd->neighbors_start[i]; k < vd->neighbors_start[i + 1] && lo <= hi; ++k) {
+        uint32_t j = vd->neighbors.items[k];
+        Point sj = seeds[j];
+        // i wins at x when a*x + c < 0, or <= 0 when i has the smaller index
+        int64_t a = 2*(int64_t)(sj.x - si.x);
+        int64_t dyi = y - si.y;
+        int64_t dyj = y - sj.y;
+        int64_t c = (int64_t)si.x*si.x - (int64_t)sj.x*sj.x + dyi*dyi - dyj*dyj;
+        bool strict = i > j;
+        if (a == 0) {
+            if (strict ? c >= 0 : c > 0) return false;
+        } else if (a > 0) {
+            int64_t bound = strict ? floor_div(-c - 1, a) : floor_div(-c, a);
+            if (bound < hi) hi = bound;
+        } else {
+            int64_t bound = strict ? floor_div(c, -a) + 1 : floor_div(c - 1, -a) + 1;
+            if (bound > lo) lo = bound;
+        }
+    }
+    if (lo > hi) return false;
+    *x0 = lo;
+    *x1 = hi;
+    return true;
+}
+
+// Rows the cell of the seed can touch, empty for duplicates
+void voronoi_cell_rows(const Voronoi_Diagram *vd, uint32_t seed, int *y0, int *y1)
+{
+    size_t start = vd->cells[seed];
+    size_t end = vd->cells[seed + 1];
+    if (start == end) {
+        *y0 = 0;
+        *y1 = -1;
+        return;
+    }
+
+    double min_y = vd->vertices.items[start].y;
+    double max_y = min_y;
+    for (size_t k = start; k < end; ++k) {
+        if (vd->vertices.items[k].y < min_y) min_y = vd->vertices.items[k].y;
+        if (vd->vertices.items[k].y > max_y) max_y = vd->vertices.items[k].y;
+    }
+    // One extra row on both sides for the rounding errors of the polygon,
+    // voronoi_cell_row_span() has the final say anyway
+    *y0 = (int)floor(min_y) - 1;
+    *y1 = (int)ceil(max_y) + 1;
+    if (*y0 < 0) *y0 = 0;
+    if (*y1 > canvas_height - 1) *y1 = canvas_height - 1;
+}
+
+void fill_voronoi_cell(const Voronoi_Diagram *vd, uint32_t seed)
+{
+    int y0, y1;
+    voronoi_cell_rows(vd, seed, &y0, &y1);
+    if (y0 < labels_y0) y0 = labels_y0;
+    if (y1 > labels_y0 + labels_rows - 1) y1 = labels_y0 + labels_rows - 1;
+
+    for (int y = y0; y <= y1; ++y) {
+        int x0, x1;
+        if (voronoi_cell_row_span(vd, seed, y, &x0, &x1)) {
+            fill_row(&labels[(size_t)(y - labels_y0)*canvas_width + x0], x1 - x0 + 1, seed);
+        }
+    }
+}
+
+void render_voronoi_fortune(void)
+{
+    build_voronoi_diagram(&diagram);
+
+    // Backwards, so in degenerate cases where two cells claim the same pixel
+    // the smaller index wins just like in render_voronoi_naive()
+    for (size_t i = seeds_count; i > 0; --i) {
+        fill_voronoi_cell(&diagram, i - 1);
+    }
+}
+
+// Cell polygons straight from the diagram, without rasterizing anything.
+// Coordinates are in pixels with y going down and are rounded to 1/100 of a
+// pixel. Pixel (x, y) covers the square from (x, y) to (x + 1, y + 1) like
+// in any image viewer, so seeds and polygons are shifted by half a pixel on
+// the way out. Polygons go clockwise on the screen, which is counter-clockwise
+// with y going up like GeoJSON wants it.
+typedef enum {
+    VECTOR_FORMAT_NONE = 0,
+    VECTOR_FORMAT_SVG,
+    VECTOR_FORMAT_GEOJSON,
+} Vector_Format;
+
+Vector_Format vector_format_by_path(const char *file_path)
+{
+    size_t n = strlen(file_path);
+    if (n >= 4 && strcmp(file_path + n - 4, ".svg") == 0) return VECTOR_FORMAT_SVG;
+    if (n >= 8 && strcmp(file_path + n - 8, ".geojson") == 0) return VECTOR_FORMAT_GEOJSON;
+    return VECTOR_FORMAT_NONE;
+}
+
+// printf() with doubles is the bottleneck of big exports otherwise
+void write_vector_coordinate(FILE *f, double value)
+{
+    char buffer[32];
+    char *end = buffer + sizeof(buffer);
+    char *p = end;
+    int64_t hundredths = llround(value*100);
+    bool negative = hundredths < 0;
+    if (negative) hundredths = -hundredths;
+
+    int fraction = hundredths%100;
+    if (fraction != 0) {
+        if (fraction%10 != 0) *--p = '0' + fraction%10;
+        *--p = '0' + fraction/10;
+        *--p = '.';
+    }
+    int64_t whole = hundredths/100;
+    do {
+        *--p = '0' + whole%10;
+        whole /= 10;
+    } while (whole > 0);
+    if (negative) *--p = '-';
+    fwrite(p, 1, end - p, f);
+}
+
+void write_vector_color(FILE *f, Color32 color)
+{
+    fprintf(f, "#%02x%02x%02x", color&0xFF, (color>>8)&0xFF, (color>>16)&0xFF);
+}
+
+typedef struct {
+    FILE *f;
+    const char *file_path;
+    Vector_Format format;
+    bool first_feature;
+} Vector_Writer;
+
+void vector_writer_open(Vector_Writer *w, const char *file_path)
+{
+    w->file_path = file_path;
+    w->format = vector_format_by_path(file_path);
+    w->first_feature = true;
+    w->f = fopen(file_path, "w");
+    if (w->f == NULL) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+
+    switch (w->format) {
+    case VECTOR_FORMAT_SVG:
+        fprintf(w->f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+                canvas_width, canvas_height, canvas_width, canvas_height);
+        fprintf(w->f, "<rect width=\"%d\" height=\"%d\" fill=\"", canvas_width, canvas_height);
+        write_vector_color(w->f, BACKGROUND_COLOR);
+        fprintf(w->f, "\"/>\n");
+        break;
+    case VECTOR_FORMAT_GEOJSON:
+        fprintf(w->f, "{\"type\":\"FeatureCollection\",\"features\":[");
+        break;
+    default:
+        UNREACHABLE("Unexpected vector format");
+    }
+}
+
+void vector_writer_cell(Vector_Writer *w, uint32_t seed, const Vertex *vs, size_t count)
+{
+    FILE *f = w->f;
+    switch (w->format) {
+    case VECTOR_FORMAT_SVG:
+        fprintf(f, "<path fill=\"");
+        write_vector_color(f, palette[seed%palette_count]);
+        fprintf(f, "\" d=\"");
+        for (size_t k = 0; k < count; ++k) {
+            fputc(k == 0 ? 'M' : 'L', f);
+            write_vector_coordinate(f, vs[k].x + 0.5);
+            fputc(' ', f);
+            write_vector_coordinate(f, vs[k].y + 0.5);
+        }
+        fprintf(f, "Z\"/>\n");
+        break;
+    case VECTOR_FORMAT_GEOJSON:
+        fprintf(f, "%s\n{\"type\":\"Feature\",\"properties\":{\"seed\":%u,\"fill\":\"", w->first_feature ? "" : ",", seed);
+        write_vector_color(f, palette[seed%palette_count]);
+        fprintf(f, "\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[");
+        // Rings repeat their first vertex at the end
+        for (size_t k = 0; k <= count; ++k) {
+            fputs(k == 0 ? "[" : ",[", f);
+            write_vector_coordinate(f, vs[k%count].x + 0.5);
+            fputc(',', f);
+            write_vector_coordinate(f, vs[k%count].y + 0.5);
+            fputc(']', f);
+        }
+        fprintf(f, "]]}}");
+        w->first_feature = false;
+        break;
+    default:
+        UNREACHABLE("Unexpected vector format");
+    }
+}
+
+// Seed markers on top of the cells, then the end of the file
+void vector_writer_close(Vector_Writer *w)
+{
+    FILE *f = w->f;
+    switch (w->format) {
+    case VECTOR_FORMAT_SVG:
+        fprintf(f, "<g fill=\"");
+        write_vector_color(f, SEED_MARKER_COLOR);
+        fprintf(f, "\">\n");
+        for (size_t k = 0; k < markers_count; ++k) {
+            Point seed = seeds[markers_order[k]];
+            fprintf(f, "<circle cx=\"%d.5\" cy=\"%d.5\" r=\"%d\"/>\n", seed.x, seed.y, SEED_MARKER_RADIUS);
+        }
+        fprintf(f, "</g>\n</svg>\n");
+        break;
+    case VECTOR_FORMAT_GEOJSON:
+        for (size_t k = 0; k < markers_count; ++k) {
+            uint32_t i = markers_order[k];
+            fprintf(f, "%s\n{\"type\":\"Feature\",\"properties\":{\"seed\":%u,\"marker-color\":\"", w->first_feature ? "" : ",", i);
+            write_vector_color(f, SEED_MARKER_COLOR);
+            fprintf(f, "\"},\"geometry\":{\"type\":\"Point\",\"coordinates\":[%d.5,%d.5]}}", seeds[i].x, seeds[i].y);
+            w->first_feature = false;
+        }
+        fprintf(f, "\n]}\n");
+        break;
+    default:
+        UNREACHABLE("Unexpected vector format");
+    }
+    close_written_file(f, w->file_path);
+}
+
+// Only the neighbours of the cells are kept around, every polygon is clipped
+// into the same scratch right before it is written out. Goes after
+// everything else that needs the scratch memory of the engines.
+void save_vectors(const char **file_paths, size_t file_paths_count)
+{
+    arena.size = arena_render_mark;
+    build_voronoi_neighbors(&diagram);
+
+    Vector_Writer writers[MAX_OUTPUTS];
+    assert(file_paths_count <= MAX_OUTPUTS);
+    for (size_t k = 0; k < file_paths_count; ++k) {
+        vector_writer_open(&writers[k], file_paths[k]);
+    }
+
+    Vertices polygon = {0};
+    Indices sides = {0};
+    for (size_t i = 0; i < seeds_count; ++i) {
+        polygon.count = 0;
+        sides.count = 0;
+        size_t count = clip_voronoi_cell(&diagram, i, &polygon, &sides);
+        if (count == 0) continue;
+        for (size_t k = 0; k < file_paths_count; ++k) {
+            vector_writer_cell(&writers[k], i, polygon.items, count);
+        }
+    }
+    free(polygon.items);
+    free(sides.items);
+
+    for (size_t k = 0; k < file_paths_count; ++k) {
+        vector_writer_close(&writers[k]);
+    }
+}
+
+// A row of a Voronoi image is a handful of long runs of the same cell.
+// Dropping the x^2 that every seed shares, the squared distance from
+// (x, y) to seed i is the line -2*xi*x + xi^2 + (y - yi)^2, so the runs of a
+// row are the lower envelope of those lines, found with a monotone convex
+// hull trick over the seeds sorted by x.
+
+typedef struct {
+    uint32_t x;
+    uint32_t length;
+    uint32_t seed;
+} Span;
+
+typedef struct {
+    Span *items;
+    size_t count;
+    size_t capacity;
+    // Spans of row y are items[rows[y]..rows[y + 1]], left to right
+    size_t *rows;
+} Spans;
+
+static Spans spans;
+static uint32_t *spans_order;
+static uint32_t *spans_hull;
+static int64_t *spans_starts;
+
+int compare_spans_order(const void *a, const void *b)
+{
+    uint32_t i = *(const uint32_t*)a;
+    uint32_t j = *(const uint32_t*)b;
+    if (seeds[i].x != seeds[j].x) return seeds[i].x < seeds[j].x ? -1 : 1;
+    return i < j ? -1 : i > j;
+}
+
+int64_t span_line_offset(uint32_t i, int y)
+{
+    int64_t dy = y - seeds[i].y;
+    return (int64_t)seeds[i].x*seeds[i].x + dy*dy;
+}
+
+// First x where seed j (to the right of seed i) is closer than seed i,
+// or equally close with a smaller index
+int64_t span_first_win(uint32_t i, uint32_t j, int y)
+{
+    int64_t a = 2*(int64_t)(seeds[j].x - seeds[i].x);
+    int64_t c = span_line_offset(j, y) - span_line_offset(i, y);
+    assert(a > 0);
+    return j < i ? floor_div(c + a - 1, a) : floor_div(c, a) + 1;
+}
+
+// Seeds that own some part of row y from left to right into hull, the x
+// where each of them starts winning into starts. Seeds must already be
+// sorted into spans_order. Returns how many there are.
+size_t build_row_hull(int y, uint32_t *hull, int64_t *starts)
+{
+    size_t hull_count = 0;
+    for (size_t k = 0; k < seeds_count; ++k) {
+        uint32_t i = spans_order[k];
+        if (hull_count > 0) {
+            uint32_t top = hull[hull_count - 1];
+            if (seeds[top].x == seeds[i].x) {
+                // Same line slope, only the closer one matters. The index
+                // order of the sort makes the earlier one win ties.
+                if (span_line_offset(i, y) >= span_line_offset(top, y)) continue;
+                hull_count -= 1;
+            }
+        }
+        while (hull_count > 0) {
+            uint32_t top = hull[hull_count - 1];
+            int64_t start = span_first_win(top, i, y);
+            if (hull_count > 1 && starts[hull_count - 1] >= start) {
+                hull_count -= 1;
+                continue;
+            }
+            starts[hull_count] = start;
+            break;
+        }
+        if (hull_count == 0) starts[0] = INT64_MIN;
+        hull[hull_count++] = i;
+    }
+    return hull_count;
+}
+
+// Pixels of the row that the k-th seed of the hull owns are [*x0, *x1),
+// false if it owns none of them
+bool row_hull_span(const int64_t *starts, size_t hull_count, size_t k, int *x0, int *x1)
+{
+    *x0 = starts[k] > 0 ? starts[k] : 0;
+    *x1 = k + 1 < hull_count && starts[k + 1] < canvas_width ? starts[k + 1] : canvas_width;
+    return *x0 < *x1;
+}
+
+// Appends the spans of row y
+void build_row_spans(Spans *ss, int y)
+{
+    size_t hull_count = build_row_hull(y, spans_hull, spans_starts);
+    for (size_t k = 0; k < hull_count; ++k) {
+        int x0, x1;
+        if (row_hull_span(spans_starts, hull_count, k, &x0, &x1)) {
+            Span span = {.x = x0, .length = x1 - x0, .seed = spans_hull[k]};
+            da_append(ss, span);
+        }
+    }
+}
+
+void build_voronoi_spans(Spans *ss)
+{
+    spans_order = arena_alloc(&arena, seeds_count*sizeof(*spans_order));
+    spans_hull = arena_alloc(&arena, seeds_count*sizeof(*spans_hull));
+    spans_starts = arena_alloc(&arena, seeds_count*sizeof(*spans_starts));
+    ss->rows = arena_alloc(&arena, ((size_t)canvas_height + 1)*sizeof(*ss->rows));
+
+    for (size_t i = 0; i < seeds_count; ++i) spans_order[i] = i;
+    qsort(spans_order, seeds_count, sizeof(spans_order[0]), compare_spans_order);
+
+    ss->count = 0;
+    for (int y = 0; y < canvas_height; ++y) {
+        ss->rows[y] = ss->count;
+        build_row_spans(ss, y);
+    }
+    ss->rows[canvas_height] = ss->count;
+}
+
+void render_voronoi_spans(void)
+{
+    build_voronoi_spans(&spans);
+    for (int y = 0; y < canvas_height; ++y) {
+        for (size_t k = spans.rows[y]; k < spans.rows[y + 1]; ++k) {
+            Span span = spans.items[k];
+            fill_row(&labels[(size_t)y*canvas_width + span.x], span.length, span.seed);
+        }
+    }
+}
+
+// Lloyd relaxation stops once every centroid is closer than this many
+// pixels to its seed. Seeds only live on whole pixels, so going below one
+// pixel mostly makes them jitter back and forth.
+#define LLOYD_MIN_DISPLACEMENT 1.0
+
+typedef struct {
+    int64_t x, y, count;
+} Lloyd_Sum;
+
+// Per worker sums of the coordinates of the pixels of every cell
+static Lloyd_Sum *lloyd_sums;
+
+// Rasterizes row y as runs of pixels of the same cell and adds every run to
+// the sums of its cell right away
+void lloyd_row_task(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    int y = task_index;
+    uint32_t *hull = &spans_hull[worker_index*seeds_count];
+    int64_t *starts = &spans_starts[worker_index*seeds_count];
+    Lloyd_Sum *sums = &lloyd_sums[worker_index*seeds_count];
+
+    size_t hull_count = build_row_hull(y, hull, starts);
+    for (size_t k = 0; k < hull_count; ++k) {
+        int x0, x1;
+        if (row_hull_span(starts, hull_count, k, &x0, &x1)) {
+            int64_t length = x1 - x0;
+            Lloyd_Sum *sum = &sums[hull[k]];
+            sum->x += ((int64_t)x0 + x1 - 1)*length/2;
+            sum->y += (int64_t)y*length;
+            sum->count += length;
+        }
+    }
+}
+
+// Moves every seed to the centroid of the pixels of its cell, up to
+// `iterations` times. Seeds stay on whole pixels and ones without any pixels
+// do not move.
+void lloyd_relax(size_t iterations)
+{
+    size_t mark = arena.size;
+    size_t threads_count = pool.threads_count;
+    spans_order = arena_alloc(&arena, seeds_count*sizeof(*spans_order));
+    spans_hull = arena_alloc(&arena, threads_count*seeds_count*sizeof(*spans_hull));
+    spans_starts = arena_alloc(&arena, threads_count*seeds_count*sizeof(*spans_starts));
+    lloyd_sums = arena_alloc(&arena, threads_count*seeds_count*sizeof(*lloyd_sums));
+
+    size_t iteration = 0;
+    double max_displacement = 0;
+    while (iteration < iterations) {
+        for (size_t i = 0; i < seeds_count; ++i) spans_order[i] = i;
+        qsort(spans_order, seeds_count, sizeof(spans_order[0]), compare_spans_order);
+        memset(lloyd_sums, 0, threads_count*seeds_count*sizeof(*lloyd_sums));
+        pool_run(lloyd_row_task, NULL, canvas_height);
+
+        max_displacement = 0;
+        for (size_t i = 0; i < seeds_count; ++i) {
+            Lloyd_Sum sum = lloyd_sums[i];
+            for (size_t w = 1; w < threads_count; ++w) {
+                sum.x += lloyd_sums[w*seeds_count + i].x;
+                sum.y += lloyd_sums[w*seeds_count + i].y;
+                sum.count += lloyd_sums[w*seeds_count + i].count;
+            }
+            if (sum.count == 0) continue;
+
+            double cx = (double)sum.x/sum.count;
+            double cy = (double)sum.y/sum.count;
+            double displacement = sqrt((cx - seeds[i].x)*(cx - seeds[i].x) + (cy - seeds[i].y)*(cy - seeds[i].y));
+            if (displacement > max_displacement) max_displacement = displacement;
+            seeds[i].x = lround(cx);
+            seeds[i].y = lround(cy);
+        }
+        iteration += 1;
+        if (max_displacement < LLOYD_MIN_DISPLACEMENT) break;
+    }
+    printf("INFO: lloyd relaxation did %zu iteration(s), the last one moved the seeds by up to %.3f pixels\n",
+           iteration, max_displacement);
+
+    arena.size = mark;
+}
+
+// Exact Euclidean distance transform by Felzenszwalb and Huttenlocher, carrying
+// the index of the closest seed along. The column pass finds the closest
+// seed within every column, the row pass takes the lower envelope of the
+// parabolas (x - column)^2 + dy^2 of every column of the row. Both are
+// linear in the pixels count no matter how many seeds there are, and ties
+// go to the smallest index like everywhere else.
+#define EDT_STRIP_SIZE 64
+// No seed in the whole column
+#define EDT_NO_SEED INT_MAX
+
+void render_voronoi_edt_strip(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    (void) worker_index;
+    int x0 = task_index*EDT_STRIP_SIZE;
+    int x1 = x0 + EDT_STRIP_SIZE < canvas_width ? x0 + EDT_STRIP_SIZE : canvas_width;
+    int last_y[EDT_STRIP_SIZE];
+    Label last_label[EDT_STRIP_SIZE];
+
+    // Downwards, the closest seed above or at the pixel. Seed pixels are
+    // the only ones with a label at this point.
+    for (int x = x0; x < x1; ++x) last_y[x - x0] = -1;
+    for (int y = 0; y < canvas_height; ++y) {
+        size_t row = (size_t)y*canvas_width;
+        for (int x = x0; x < x1; ++x) {
+            if (labels[row + x] != LABEL_NONE) {
+                last_y[x - x0] = y;
+                last_label[x - x0] = labels[row + x];
+            }
+            if (last_y[x - x0] >= 0) {
+                edt_dy[row + x] = y - last_y[x - x0];
+                labels[row + x] = last_label[x - x0];
+            } else {
+                edt_dy[row + x] = EDT_NO_SEED;
+            }
+        }
+    }
+
+    // Upwards, the closest seed below if it beats the one above
+    for (int x = x0; x < x1; ++x) last_y[x - x0] = -1;
+    for (int y = canvas_height - 1; y >= 0; --y) {
+        size_t row = (size_t)y*canvas_width;
+        for (int x = x0; x < x1; ++x) {
+            if (edt_dy[row + x] == 0) {
+                last_y[x - x0] = y;
+                last_label[x - x0] = labels[row + x];
+            } else if (last_y[x - x0] >= 0) {
+                int dy = last_y[x - x0] - y;
+                if (dy < edt_dy[row + x] || (dy == edt_dy[row + x] && last_label[x - x0] < labels[row + x])) {
+                    edt_dy[row + x] = dy;
+                    labels[row + x] = last_label[x - x0];
+                }
+            }
+        }
+    }
+}
+
+int64_t edt_column_offset(int x, int dy)
+{
+    return (int64_t)x*x + (int64_t)dy*dy;
+}
+
+// First pixel where column j (to the right of column i) is closer than
+// column i, or equally close with a smaller label
+int64_t edt_first_win(int i, int j, const int *dy, const Label *column_labels)
+{
+    int64_t a = 2*(int64_t)(j - i);
+    int64_t c = edt_column_offset(j, dy[j]) - edt_column_offset(i, dy[i]);
+    return column_labels[j] < column_labels[i] ? floor_div(c + a - 1, a) : floor_div(c, a) + 1;
+}
+
+void render_voronoi_edt_row(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    int y = task_index;
+    size_t row = (size_t)y*canvas_width;
+    const int *dy = &edt_dy[row];
+    int *hull = &edt_hull[worker_index*canvas_width];
+    int64_t *starts = &edt_starts[worker_index*canvas_width];
+    Label *column_labels = &edt_column_labels[worker_index*canvas_width];
+    memcpy(column_labels, &labels[row], canvas_width*sizeof(*column_labels));
+
+    size_t hull_count = 0;
+    for (int x = 0; x < canvas_width; ++x) {
+        if (dy[x] == EDT_NO_SEED) continue;
+        while (hull_count > 0) {
+            int64_t start = edt_first_win(hull[hull_count - 1], x, dy, column_labels);
+            if (hull_count > 1 && starts[hull_count - 1] >= start) {
+                hull_count -= 1;
+                continue;
+            }
+            starts[hull_count] = start;
+            break;
+        }
+        if (hull_count == 0) starts[0] = INT64_MIN;
+        hull[hull_count++] = x;
+    }
+
+    for (size_t k = 0; k < hull_count; ++k) {
+        int64_t x0 = starts[k] > 0 ? starts[k] : 0;
+        int64_t x1 = k + 1 < hull_count && starts[k + 1] < canvas_width ? starts[k + 1] : canvas_width;
+        int column = hull[k];
+        fill_row(&labels[row + x0], x1 > x0 ? x1 - x0 : 0, column_labels[column]);
+        if (edt_distances != NULL) {
+            for (int64_t x = x0; x < x1; ++x) {
+                int64_t dx = x - column;
+                edt_distances[row + x] = sqrt((double)(dx*dx + (int64_t)dy[column]*dy[column]));
+            }
+        }
+    }
+}
+
+void render_voronoi_edt(void)
+{
+    size_t n = pixels_count();
+    edt_dy = arena_alloc(&arena, n*sizeof(*edt_dy));
+    edt_hull = arena_alloc(&arena, pool.threads_count*canvas_width*sizeof(*edt_hull));
+    edt_starts = arena_alloc(&arena, pool.threads_count*canvas_width*sizeof(*edt_starts));
+    edt_column_labels = arena_alloc(&arena, pool.threads_count*canvas_width*sizeof(*edt_column_labels));
+    edt_distances = edt_export_distances ? arena_alloc(&arena, n*sizeof(*edt_distances)) : NULL;
+
+    // Backwards, so the smallest index wins on duplicate seeds
+    for (size_t i = seeds_count; i > 0; --i) {
+        labels[(size_t)seeds[i - 1].y*canvas_width + seeds[i - 1].x] = i - 1;
+    }
+
+    pool_run(render_voronoi_edt_strip, NULL, (canvas_width + EDT_STRIP_SIZE - 1)/EDT_STRIP_SIZE);
+    pool_run(render_voronoi_edt_row, NULL, canvas_height);
+}
+
+// Portable Float Map, rows go from the bottom to the top
+void save_distance_field(const char *file_path)
+{
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+    // Negative scale means little endian
+    fprintf(f, "Pf\n%d %d\n-1.0\n", canvas_width, canvas_height);
+    for (int y = canvas_height - 1; y >= 0; --y) {
+        fwrite(&edt_distances[(size_t)y*canvas_width], sizeof(*edt_distances), canvas_width, f);
+    }
+    close_written_file(f, file_path);
+}
+
+// Seeds can be inserted and deleted after the first render. The labels and a
+// full canvas depth stay alive between the edits, so an edit only touches
+// the pixels that change owner and the tiles around them.
+typedef struct {
+    int x0, y0, x1, y1;
+} Rect;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Seed_List;
+
+static int *dynamic_depth;
+// Upper bound of the depth of every tile. An inserted seed can only win
+// pixels of the tiles that have some pixel closer to it than that.
+static int *dynamic_tile_max_depth;
+// Superset of the pixels of every seed. A delete only looks there.
+static Rect *seed_bboxes;
+// Like the grid of build_seed_grid() but for the alive seeds only, and in
+// no particular order inside of a cell
+static int dynamic_grid_cell_size;
+static int dynamic_grid_cols;
+static int dynamic_grid_rows;
+static Seed_List *dynamic_grid;
+static size_t alive_seeds_count;
+// Pixels looked at by the edits so far
+static size_t dynamic_pixels_touched;
+
+Seed_List *dynamic_grid_cell_of(Point p)
+{
+    return &dynamic_grid[(size_t)(p.y/dynamic_grid_cell_size)*dynamic_grid_cols + p.x/dynamic_grid_cell_size];
+}
+
+// The lists of the cells grow with realloc(), outside of the arena, so they
+// have to go before the arena is reset for the next render
+void dynamic_grid_free(void)
+{
+    if (dynamic_grid == NULL) return;
+    size_t cells_count = (size_t)dynamic_grid_cols*dynamic_grid_rows;
+    for (size_t i = 0; i < cells_count; ++i) {
+        free(dynamic_grid[i].items);
+    }
+    dynamic_grid = NULL;
+}
+
+void dynamic_grid_scan_cell(int gx, int gy, int x, int y, uint32_t *best, int64_t *best_dist)
+{
+    if (gx < 0 || gx >= dynamic_grid_cols || gy < 0 || gy >= dynamic_grid_rows) return;
+    Seed_List *cell = &dynamic_grid[(size_t)gy*dynamic_grid_cols + gx];
+    for (size_t k = 0; k < cell->count; ++k) {
+        uint32_t i = cell->items[k];
+        int64_t d = sqr_dist(seeds[i].x, seeds[i].y, x, y);
+        if (d < *best_dist || (d == *best_dist && i < *best)) {
+            *best = i;
+            *best_dist = d;
+        }
+    }
+}
+
+// Same ring search as seed_grid_nearest()
+uint32_t dynamic_grid_nearest(int x, int y)
+{
+    int cx = x/dynamic_grid_cell_size;
+    int cy = y/dynamic_grid_cell_size;
+    uint32_t best = UINT32_MAX;
+    int64_t best_dist = INT64_MAX;
+
+    int max_ring = dynamic_grid_cols > dynamic_grid_rows ? dynamic_grid_cols : dynamic_grid_rows;
+    for (int r = 0; r < max_ring; ++r) {
+        if (r == 0) {
+            dynamic_grid_scan_cell(cx, cy, x, y, &best, &best_dist);
+        } else {
+            for (int gx = cx - r; gx <= cx + r; ++gx) {
+                dynamic_grid_scan_cell(gx, cy - r, x, y, &best, &best_dist);
+                dynamic_grid_scan_cell(gx, cy + r, x, y, &best, &best_dist);
+            }
+            for (int gy = cy - r + 1; gy < cy + r; ++gy) {
+                dynamic_grid_scan_cell(cx - r, gy, x, y, &best, &best_dist);
+                dynamic_grid_scan_cell(cx + r, gy, x, y, &best, &best_dist);
+            }
+        }
+
+        int64_t reach = x - (int64_t)(cx - r)*dynamic_grid_cell_size;
+        int64_t right = (int64_t)(cx + r + 1)*dynamic_grid_cell_size - x;
+        int64_t top = y - (int64_t)(cy - r)*dynamic_grid_cell_size;
+        int64_t bottom = (int64_t)(cy + r + 1)*dynamic_grid_cell_size - y;
+        if (right < reach) reach = right;
+        if (top < reach) reach = top;
+        if (bottom < reach) reach = bottom;
+        if (best != UINT32_MAX && reach*reach > best_dist) break;
+    }
+
+    return best;
+}
+
+void rect_extend(Rect *r, int x, int y)
+{
+    if (x < r->x0) r->x0 = x;
+    if (y < r->y0) r->y0 = y;
+    if (x + 1 > r->x1) r->x1 = x + 1;
+    if (y + 1 > r->y1) r->y1 = y + 1;
+}
+
+// Runs the new seed s over the tile (gx, gy) if the tile can have pixels
+// closer to it than their current seed. Tells whether the pixels the seed
+// wins may still go on past the tile.
+bool dynamic_insert_into_tile(uint32_t s, int gx, int gy, Rect *bbox)
+{
+    int cols = (canvas_width + TILE_SIZE - 1)/TILE_SIZE;
+    int rows = (canvas_height + TILE_SIZE - 1)/TILE_SIZE;
+    if (gx < 0 || gx >= cols || gy < 0 || gy >= rows) return false;
+
+    Point p = seeds[s];
+    size_t t = (size_t)gy*cols + gx;
+    Tile tile = tile_by_index(t);
+    int64_t dx = p.x < tile.x0 ? tile.x0 - p.x : p.x >= tile.x1 ? p.x - (tile.x1 - 1) : 0;
+    int64_t dy = p.y < tile.y0 ? tile.y0 - p.y : p.y >= tile.y1 ? p.y - (tile.y1 - 1) : 0;
+    int64_t d = dx*dx + dy*dy;
+    // The won pixels are the pixel centers inside of a convex region around
+    // the seed. A segment of that region can pass through the tile between
+    // its pixel centers, each of them at most sqrt(2) further away from the
+    // seed than from the segment, so 2 pixels of slack keep the walk going.
+    bool reachable = sqrt((double)d) < sqrt((double)dynamic_tile_max_depth[t]) + 2.0;
+    if (d >= dynamic_tile_max_depth[t]) return reachable;
+
+    Apply_Seed_Row apply_seed_row = simd_kernel->apply_seed_row[METRIC_EUCLIDEAN];
+    int max_depth = 0;
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        size_t row = (size_t)y*canvas_width;
+        int ry = y - p.y;
+        apply_seed_row(&dynamic_depth[row + tile.x0], &labels[row + tile.x0], tile.x1 - tile.x0, tile.x0 - p.x, ry, 0, s);
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            if (labels[row + x] == s) rect_extend(bbox, x, y);
+            if (dynamic_depth[row + x] > max_depth) max_depth = dynamic_depth[row + x];
+        }
+    }
+    dynamic_tile_max_depth[t] = max_depth;
+    dynamic_pixels_touched += (size_t)(tile.x1 - tile.x0)*(tile.y1 - tile.y0);
+    return reachable;
+}
+
+// The seed gets the next index, so it loses all the ties and only takes the
+// pixels it is strictly closer to. Those are found by the kernels of the
+// interesting engine in rings of tiles around the seed, until a whole ring
+// is out of reach, so the cost follows the size of the new cell and not of
+// the canvas.
+uint32_t dynamic_insert_seed(Point p)
+{
+    assert(seeds_count < seeds_capacity);
+    uint32_t s = seeds_count++;
+    seeds[s] = p;
+    seed_alive[s] = true;
+    alive_seeds_count += 1;
+    da_append(dynamic_grid_cell_of(p), s);
+
+    Rect bbox = {canvas_width, canvas_height, 0, 0};
+    int cx = p.x/TILE_SIZE;
+    int cy = p.y/TILE_SIZE;
+    dynamic_insert_into_tile(s, cx, cy, &bbox);
+    for (int r = 1; ; ++r) {
+        bool reachable = false;
+        for (int gx = cx - r; gx <= cx + r; ++gx) {
+            if (dynamic_insert_into_tile(s, gx, cy - r, &bbox)) reachable = true;
+            if (dynamic_insert_into_tile(s, gx, cy + r, &bbox)) reachable = true;
+        }
+        for (int gy = cy - r + 1; gy < cy + r; ++gy) {
+            if (dynamic_insert_into_tile(s, cx - r, gy, &bbox)) reachable = true;
+            if (dynamic_insert_into_tile(s, cx + r, gy, &bbox)) reachable = true;
+        }
+        if (!reachable) break;
+    }
+    seed_bboxes[s] = bbox;
+    return s;
+}
+
+// Pixels of the deleted seed go to the closest alive seed, everything else
+// stays as it is
+void dynamic_delete_seed(uint32_t s)
+{
+    assert(seed_alive[s]);
+    assert(alive_seeds_count > 1);
+    seed_alive[s] = false;
+    alive_seeds_count -= 1;
+
+    Seed_List *cell = dynamic_grid_cell_of(seeds[s]);
+    for (size_t k = 0; k < cell->count; ++k) {
+        if (cell->items[k] == s) {
+            cell->items[k] = cell->items[--cell->count];
+            break;
+        }
+    }
+
+    Rect bbox = seed_bboxes[s];
+    for (int y = bbox.y0; y < bbox.y1; ++y) {
+        for (int x = bbox.x0; x < bbox.x1; ++x) {
+            size_t i = (size_t)y*canvas_width + x;
+            if (labels[i] != s) continue;
+            uint32_t j = dynamic_grid_nearest(x, y);
+            labels[i] = j;
+            dynamic_depth[i] = sqr_dist(seeds[j].x, seeds[j].y, x, y);
+            rect_extend(&seed_bboxes[j], x, y);
+            size_t t = tile_index_of(x, y);
+            if (dynamic_depth[i] > dynamic_tile_max_depth[t]) dynamic_tile_max_depth[t] = dynamic_depth[i];
+        }
+    }
+    dynamic_pixels_touched += (size_t)(bbox.x1 - bbox.x0)*(bbox.y1 - bbox.y0);
+}
+
+// The first render is just all the seeds inserted one by one into an empty
+// canvas
+void render_voronoi_dynamic(void)
+{
+    if (sqr_dist(0, 0, canvas_width - 1, canvas_height - 1) >= INT_MAX) {
+        fprintf(stderr, "ERROR: %dx%d canvas does not fit into the 32-bit depth buffer of the dynamic engine, try another engine\n",
+                canvas_width, canvas_height);
+        exit(1);
+    }
+
+    size_t n = pixels_count();
+    dynamic_depth = arena_alloc(&arena, n*sizeof(*dynamic_depth));
+    for (size_t i = 0; i < n; ++i) dynamic_depth[i] = INT_MAX;
+    dynamic_tile_max_depth = arena_alloc(&arena, tiles_count()*sizeof(*dynamic_tile_max_depth));
+    for (size_t t = 0; t < tiles_count(); ++t) dynamic_tile_max_depth[t] = INT_MAX;
+    seed_alive = arena_alloc(&arena, seeds_capacity*sizeof(*seed_alive));
+    seed_bboxes = arena_alloc(&arena, seeds_capacity*sizeof(*seed_bboxes));
+
+    // Roughly 2 seeds per cell at the start
+    dynamic_grid_cell_size = ceil_sqrt(((size_t)canvas_width*canvas_height*2 + seeds_count - 1)/seeds_count);
+    if (dynamic_grid_cell_size < 1) dynamic_grid_cell_size = 1;
+    dynamic_grid_cols = (canvas_width + dynamic_grid_cell_size - 1)/dynamic_grid_cell_size;
+    dynamic_grid_rows = (canvas_height + dynamic_grid_cell_size - 1)/dynamic_grid_cell_size;
+    size_t cells_count = (size_t)dynamic_grid_cols*dynamic_grid_rows;
+    dynamic_grid = arena_alloc(&arena, cells_count*sizeof(*dynamic_grid));
+    memset(dynamic_grid, 0, cells_count*sizeof(*dynamic_grid));
+
+    size_t initial_count = seeds_count;
+    seeds_count = 0;
+    alive_seeds_count = 0;
+    for (size_t i = 0; i < initial_count; ++i) {
+        dynamic_insert_seed(seeds[i]);
+    }
+    dynamic_pixels_touched = 0;
+}
+
+// Random inserts and deletes on top of render_voronoi_dynamic(), half of
+// each on average
+void dynamic_random_edits(size_t edits_count)
+{
+    size_t inserts = 0, deletes = 0;
+    double insert_secs = 0.0, delete_secs = 0.0;
+    size_t insert_pixels = 0, delete_pixels = 0;
+    for (size_t k = 0; k < edits_count; ++k) {
+        size_t touched = dynamic_pixels_touched;
+        if (alive_seeds_count > 1 && rand()%2 == 0) {
+            uint32_t s;
+            do s = rand()%seeds_count; while (!seed_alive[s]);
+            double start = get_secs();
+            dynamic_delete_seed(s);
+            delete_secs += get_secs() - start;
+            delete_pixels += dynamic_pixels_touched - touched;
+            deletes += 1;
+        } else {
+            Point p = {rand()%canvas_width, rand()%canvas_height};
+            double start = get_secs();
+            dynamic_insert_seed(p);
+            insert_secs += get_secs() - start;
+            insert_pixels += dynamic_pixels_touched - touched;
+            inserts += 1;
+        }
+    }
+    sort_seed_markers();
+
+    if (inserts > 0) {
+        printf("INFO: %zu inserts, %.3fms and %zu pixels touched on average\n",
+               inserts, 1000.0*insert_secs/inserts, insert_pixels/inserts);
+    }
+    if (deletes > 0) {
+        printf("INFO: %zu deletes, %.3fms and %zu pixels touched on average\n",
+               deletes, 1000.0*delete_secs/deletes, delete_pixels/deletes);
+    }
+}
+
+// What the naive engine would say about the alive seeds only
+size_t dynamic_count_pixels_differing_from_naive(void)
+{
+    size_t count = 0;
+    for (int y = 0; y < canvas_height; ++y) {
+        for (int x = 0; x < canvas_width; ++x) {
+            uint32_t best = UINT32_MAX;
+            int64_t best_dist = INT64_MAX;
+            for (size_t i = 0; i < seeds_count; ++i) {
+                if (!seed_alive[i]) continue;
+                int64_t d = sqr_dist(seeds[i].x, seeds[i].y, x, y);
+                if (d < best_dist) {
+                    best = i;
+                    best_dist = d;
+                }
+            }
+            if (labels[(size_t)y*canvas_width + x] != best) count += 1;
+        }
+    }
+    return count;
+}
+
+typedef enum {
+    ENGINE_NAIVE = 0,
+    ENGINE_INTERESTING,
+    ENGINE_JFA,
+    ENGINE_GRID,
+    ENGINE_FORTUNE,
+    ENGINE_SPANS,
+    ENGINE_EDT,
+    ENGINE_QUADTREE,
+    ENGINE_DYNAMIC,
+    ENGINE_KDTREE,
+    COUNT_ENGINES,
+} Engine;
+
+static const char *engine_names[COUNT_ENGINES] = {
+    [ENGINE_NAIVE]       = "naive",
+    [ENGINE_INTERESTING] = "interesting",
+    [ENGINE_JFA]         = "jfa",
+    [ENGINE_GRID]        = "grid",
+    [ENGINE_FORTUNE]     = "fortune",
+    [ENGINE_SPANS]       = "spans",
+    [ENGINE_EDT]         = "edt",
+    [ENGINE_QUADTREE]    = "quadtree",
+    [ENGINE_DYNAMIC]     = "dynamic",
+    [ENGINE_KDTREE]      = "kdtree",
+};
+
+bool engine_supports_metric(Engine engine, Metric metric)
+{
+    switch (engine) {
+    case ENGINE_NAIVE:
+    case ENGINE_INTERESTING:
+    case ENGINE_GRID:
+        return true;
+    // Block filling needs convex cells
+    case ENGINE_QUADTREE:
+        return metric == METRIC_EUCLIDEAN || metric == METRIC_POWER;
+    default:
+        return metric == METRIC_EUCLIDEAN;
+    }
+}
+
+void render_voronoi(Engine engine)
+{
+    dynamic_grid_free();
+    arena.size = arena_render_mark;
+
+    switch (engine) {
+    case ENGINE_NAIVE:
+        render_voronoi_naive();
+        break;
+    case ENGINE_INTERESTING:
+        render_voronoi_interesting();
+        break;
+    case ENGINE_JFA:
+        render_voronoi_jfa();
+        break;
+    case ENGINE_GRID:
+        render_voronoi_grid();
+        break;
+    case ENGINE_FORTUNE:
+        render_voronoi_fortune();
+        break;
+    case ENGINE_SPANS:
+        render_voronoi_spans();
+        break;
+    case ENGINE_EDT:
+        render_voronoi_edt();
+        break;
+    case ENGINE_QUADTREE:
+        render_voronoi_quadtree();
+        break;
+    case ENGINE_DYNAMIC:
+        render_voronoi_dynamic();
+        break;
+    case ENGINE_KDTREE:
+        render_voronoi_kdtree();
+        break;
+    default:
+        UNREACHABLE("Unexpected engine");
+    }
+}
+
+// Compares the seeds the pixels belong to, not their colors, so two seeds
+// that happen to share a palette entry do not hide a difference
+size_t count_pixels_differing_from_naive(void)
+{
+    size_t n = pixels_count();
+    reference_labels = arena_alloc(&arena, n*sizeof(*reference_labels));
+    memcpy(reference_labels, labels, n*sizeof(*labels));
+    render_voronoi_naive();
+
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (labels[i] != reference_labels[i]) {
+            count += 1;
+        }
+    }
+
+    memcpy(labels, reference_labels, n*sizeof(*labels));
+    return count;
+}
+
+size_t peak_rss_kb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) return 0;
+    return usage.ru_maxrss;
+}
+
+// Statistics of every cell and which cells touch, gathered in one pass over
+// the labels. Perimeters and shared boundaries are counted in pixel sides,
+// the sides on the edges of the canvas are a part of the perimeter.
+#define STATS_STRIP_ROWS 16
+
+typedef struct {
+    int64_t area;
+    int64_t perimeter;
+    // Inclusive
+    int x0, y0, x1, y1;
+} Cell_Stats;
+
+typedef struct {
+    // a < b
+    Label a, b;
+    int64_t length;
+    // Next pair with the same a
+    uint32_t next;
+} Cell_Adjacency;
+
+typedef struct {
+    Cell_Adjacency *items;
+    size_t count;
+    size_t capacity;
+} Cell_Adjacencies;
+
+// Per worker, seeds_capacity of them each
+static Cell_Stats *cell_stats;
+static Cell_Adjacencies cell_adjacencies[MAX_THREADS];
+// First pair of every cell in cell_adjacencies of the worker
+static uint32_t *cell_adjacency_heads;
+// Unique pairs sorted by a, then by b
+static Cell_Adjacencies cell_adjacency;
+
+// A cell only has a handful of neighbours, so finding the pair in the list
+// of the cell is cheap and the lists stay as small as the result
+void add_cell_adjacency(Cell_Adjacencies *adjacencies, uint32_t *heads, Label a, Label b, int64_t length)
+{
+    if (a == LABEL_NONE || b == LABEL_NONE) return;
+    if (a > b) {
+        Label t = a;
+        a = b;
+        b = t;
+    }
+    for (uint32_t k = heads[a]; k != UINT32_MAX; k = adjacencies->items[k].next) {
+        if (adjacencies->items[k].b == b) {
+            adjacencies->items[k].length += length;
+            return;
+        }
+    }
+    Cell_Adjacency adjacency = {a, b, length, heads[a]};
+    heads[a] = adjacencies->count;
+    da_append(adjacencies, adjacency);
+}
+
+void compute_cell_stats_strip(void *ctx, size_t task_index, size_t worker_index)
+{
+    (void) ctx;
+    Cell_Stats *stats = &cell_stats[worker_index*seeds_capacity];
+    Cell_Adjacencies *adjacencies = &cell_adjacencies[worker_index];
+    uint32_t *heads = &cell_adjacency_heads[worker_index*seeds_capacity];
+    int y0 = task_index*STATS_STRIP_ROWS;
+    int y1 = y0 + STATS_STRIP_ROWS < canvas_height ? y0 + STATS_STRIP_ROWS : canvas_height;
+
+    for (int y = y0; y < y1; ++y) {
+        const Label *row = &labels[(size_t)y*canvas_width];
+        int borders = (y == 0) + (y == canvas_height - 1);
+
+        for (int x = 0; x < canvas_width;) {
+            Label label = row[x];
+            int end = x + 1;
+            while (end < canvas_width && row[end] == label) end += 1;
+            if (label != LABEL_NONE) {
+                Cell_Stats *s = &stats[label];
+                s->area += end - x;
+                // Both ends of the run are on the boundary of the cell
+                s->perimeter += 2 + (int64_t)borders*(end - x);
+                if (x < s->x0) s->x0 = x;
+                if (end - 1 > s->x1) s->x1 = end - 1;
+                if (y < s->y0) s->y0 = y;
+                if (y > s->y1) s->y1 = y;
+            }
+            if (end < canvas_width) add_cell_adjacency(adjacencies, heads, label, row[end], 1);
+            x = end;
+        }
+
+        if (y + 1 < canvas_height) {
+            const Label *below = row + canvas_width;
+            for (int x = 0; x < canvas_width;) {
+                if (row[x] == below[x]) {
+                    x += 1;
+                    continue;
+                }
+                // Same pair of cells along the boundary
+                int end = x + 1;
+                while (end < canvas_width && row[end] == row[x] && below[end] == below[x]) end += 1;
+                if (row[x] != LABEL_NONE) stats[row[x]].perimeter += end - x;
+                if (below[x] != LABEL_NONE) stats[below[x]].perimeter += end - x;
+                add_cell_adjacency(adjacencies, heads, row[x], below[x], end - x);
+                x = end;
+            }
+        }
+    }
+}
+
+// Leaves the merged stats in the first seeds_capacity of cell_stats and the
+// pairs of neighbours in cell_adjacency
+void compute_cell_stats(void)
+{
+    size_t threads_count = pool.threads_count;
+    cell_stats = arena_alloc(&arena, threads_count*seeds_capacity*sizeof(*cell_stats));
+    cell_adjacency_heads = arena_alloc(&arena, threads_count*seeds_capacity*sizeof(*cell_adjacency_heads));
+    for (size_t i = 0; i < threads_count*seeds_capacity; ++i) {
+        cell_stats[i] = (Cell_Stats) {.x0 = INT_MAX, .y0 = INT_MAX, .x1 = -1, .y1 = -1};
+        cell_adjacency_heads[i] = UINT32_MAX;
+    }
+    for (size_t w = 0; w < threads_count; ++w) {
+        cell_adjacencies[w].count = 0;
+    }
+
+    pool_run(compute_cell_stats_strip, NULL, (canvas_height + STATS_STRIP_ROWS - 1)/STATS_STRIP_ROWS);
+
+    for (size_t w = 1; w < threads_count; ++w) {
+        for (size_t i = 0; i < seeds_capacity; ++i) {
+            Cell_Stats *dst = &cell_stats[i];
+            const Cell_Stats *src = &cell_stats[w*seeds_capacity + i];
+            dst->area += src->area;
+            dst->perimeter += src->perimeter;
+            if (src->x0 < dst->x0) dst->x0 = src->x0;
+            if (src->y0 < dst->y0) dst->y0 = src->y0;
+            if (src->x1 > dst->x1) dst->x1 = src->x1;
+            if (src->y1 > dst->y1) dst->y1 = src->y1;
+        }
+        for (size_t k = 0; k < cell_adjacencies[w].count; ++k) {
+            const Cell_Adjacency *adjacency = &cell_adjacencies[w].items[k];
+            add_cell_adjacency(&cell_adjacencies[0], cell_adjacency_heads, adjacency->a, adjacency->b, adjacency->length);
+        }
+    }
+
+    cell_adjacency.count = 0;
+    for (size_t a = 0; a < seeds_capacity; ++a) {
+        size_t start = cell_adjacency.count;
+        for (uint32_t k = cell_adjacency_heads[a]; k != UINT32_MAX; k = cell_adjacencies[0].items[k].next) {
+            Cell_Adjacency adjacency = cell_adjacencies[0].items[k];
+            size_t j = cell_adjacency.count;
+            da_append(&cell_adjacency, adjacency);
+            for (; j > start && cell_adjacency.items[j - 1].b > adjacency.b; --j) {
+                cell_adjacency.items[j] = cell_adjacency.items[j - 1];
+            }
+            cell_adjacency.items[j] = adjacency;
+        }
+    }
+}
+
+// One line per cell that has any pixels
+void save_cell_stats(const char *file_path)
+{
+    FILE *f = fopen(file_path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+    fprintf(f, "seed,seed_x,seed_y,area,perimeter,x0,y0,x1,y1\n");
+    for (size_t i = 0; i < seeds_count; ++i) {
+        const Cell_Stats *s = &cell_stats[i];
+        if (s->area == 0) continue;
+        fprintf(f, "%zu,%d,%d,%"PRId64",%"PRId64",%d,%d,%d,%d\n",
+                i, seeds[i].x, seeds[i].y, s->area, s->perimeter, s->x0, s->y0, s->x1, s->y1);
+    }
+    close_written_file(f, file_path);
+}
+
+// One line per pair of cells that share a boundary, with its length
+void save_cell_adjacency(const char *file_path)
+{
+    FILE *f = fopen(file_path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not write into file %s: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+    fprintf(f, "seed_a,seed_b,boundary\n");
+    for (size_t k = 0; k < cell_adjacency.count; ++k) {
+        const Cell_Adjacency *adjacency = &cell_adjacency.items[k];
+        fprintf(f, "%u,%u,%"PRId64"\n", (unsigned) adjacency->a, (unsigned) adjacency->b, adjacency->length);
+    }
+    close_written_file(f, file_path);
+}
+
+// First and last row of every cell of the diagram
+static int *cell_first_row;
+static int *cell_last_row;
+
+int compare_cells_by_index_desc(const void *a, const void *b)
+{
+    uint32_t i = *(const uint32_t*)a;
+    uint32_t j = *(const uint32_t*)b;
+    return i < j ? 1 : i > j ? -1 : 0;
+}
+
+int compare_cells_by_first_row(const void *a, const void *b)
+{
+    int ya = cell_first_row[*(const uint32_t*)a];
+    int yb = cell_first_row[*(const uint32_t*)b];
+    return ya < yb ? -1 : ya > yb;
+}
+
+// Out-of-core mode for canvases that do not fit into memory. The labels only
+// hold band_height rows. Each band is filled from the cells of the Voronoi
+// diagram that reach into it and goes straight into the output files, so
+// the memory does not depend on the canvas height.
+void render_voronoi_in_bands(const char **output_file_paths, size_t outputs_count, int band_height)
+{
+    dynamic_grid_free();
+    arena.size = arena_render_mark;
+    build_voronoi_diagram(&diagram);
+
+    // Cells sorted by their first row, they join the active list as soon
+    // as the bands reach them and leave it once the bands are past them
+    cell_first_row = arena_alloc(&arena, seeds_count*sizeof(*cell_first_row));
+    cell_last_row = arena_alloc(&arena, seeds_count*sizeof(*cell_last_row));
+    uint32_t *cells_order = arena_alloc(&arena, seeds_count*sizeof(*cells_order));
+    size_t cells_count = 0;
+    for (size_t i = 0; i < seeds_count; ++i) {
+        voronoi_cell_rows(&diagram, i, &cell_first_row[i], &cell_last_row[i]);
+        if (cell_first_row[i] <= cell_last_row[i]) cells_order[cells_count++] = i;
+    }
+    qsort(cells_order, cells_count, sizeof(*cells_order), compare_cells_by_first_row);
+    uint32_t *band_cells = arena_alloc(&arena, cells_count*sizeof(*band_cells));
+    size_t band_cells_count = 0;
+    size_t next_cell = 0;
+
+    Image_Writer writers[MAX_OUTPUTS];
+    for (size_t k = 0; k < outputs_count; ++k) {
+        image_writer_open(&writers[k], output_file_paths[k], canvas_width, canvas_height);
+    }
+
+    size_t bands_count = (canvas_height + band_height - 1)/band_height;
+    for (size_t band = 0; band < bands_count; ++band) {
+        labels_y0 = band*band_height;
+        labels_rows = canvas_height - labels_y0 < band_height ? canvas_height - labels_y0 : band_height;
+        int band_y1 = labels_y0 + labels_rows;
+
+        size_t kept = 0;
+        for (size_t k = 0; k < band_cells_count; ++k) {
+            if (cell_last_row[band_cells[k]] >= labels_y0) band_cells[kept++] = band_cells[k];
+        }
+        band_cells_count = kept;
+        while (next_cell < cells_count && cell_first_row[cells_order[next_cell]] < band_y1) {
+            band_cells[band_cells_count++] = cells_order[next_cell++];
+        }
+
+        // Same order as render_voronoi_fortune(), the smallest index goes last
+        qsort(band_cells, band_cells_count, sizeof(*band_cells), compare_cells_by_index_desc);
+
+        clear_labels();
+        for (size_t k = 0; k < band_cells_count; ++k) {
+            fill_voronoi_cell(&diagram, band_cells[k]);
+        }
+
+        resolve_labels(writers, outputs_count, labels_y0, band_y1, palette, palette_count);
+        printf("INFO: band %zu/%zu (rows %d..%d) done, %zu cells, peak RSS %zu KB\n",
+               band + 1, bands_count, labels_y0, band_y1 - 1, band_cells_count, peak_rss_kb());
+    }
+
+    for (size_t k = 0; k < outputs_count; ++k) {
+        image_writer_close(&writers[k]);
+    }
+}
+
+void save_vector_outputs(const char **file_paths, size_t file_paths_count)
+{
+    if (file_paths_count == 0) return;
+    double start = get_secs();
+    save_vectors(file_paths, file_paths_count);
+    printf("INFO: saving %zu vector file(s) took %.3fs\n", file_paths_count, get_secs() - start);
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [OPTIONS]\n", program);
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "    --engine <name>    ");
+    for (size_t i = 0; i < COUNT_ENGINES; ++i) {
+        fprintf(stderr, "%s%s", i > 0 ? "|" : "", engine_names[i]);
+    }
+    fprintf(stderr, " (default: %s)\n", engine_names[ENGINE_INTERESTING]);
+    fprintf(stderr, "    --compare          report how many pixels differ from the naive engine\n");
+    fprintf(stderr, "    --threads <n>      worker threads, 0 means one per CPU (default: 1)\n");
+    fprintf(stderr, "    --simd <name>      ");
+    for (size_t i = 0; i < simd_kernels_count; ++i) {
+        fprintf(stderr, "%s%s", i > 0 ? "|" : "", simd_kernels[i].name);
+    }
+    fprintf(stderr, " (default: the fastest supported by the CPU)\n");
+    fprintf(stderr, "    --metric <name>    ");
+    for (size_t i = 0; i < COUNT_METRICS; ++i) {
+        fprintf(stderr, "%s%s", i > 0 ? "|" : "", metric_names[i]);
+    }
+    fprintf(stderr, " (default: %s),\n", metric_names[METRIC_EUCLIDEAN]);
+    fprintf(stderr, "                       naive, interesting and grid engines, quadtree for power too,\n");
+    fprintf(stderr, "                       minkowski uses p = %d, power and additive use random seed weights\n", MINKOWSKI_P);
+    fprintf(stderr, "    --max-weight <n>   largest seed weight of the power and additive metrics (default: %d)\n", DEFAULT_MAX_WEIGHT);
+    fprintf(stderr, "    --width <n>        canvas width (default: %d)\n", DEFAULT_WIDTH);
+    fprintf(stderr, "    --height <n>       canvas height (default: %d)\n", DEFAULT_HEIGHT);
+    fprintf(stderr, "    --seeds <n>        seeds count (default: %d)\n", DEFAULT_SEEDS_COUNT);
+    fprintf(stderr, "    --output <path>    .pam for RGBA PAM, .svg or .geojson for cell polygons, anything else is PPM\n");
+    fprintf(stderr, "                       (default: %s),\n", OUTPUT_FILE_PATH);
+    fprintf(stderr, "                       up to %d times to save the same diagram into several files\n", MAX_OUTPUTS);
+    fprintf(stderr, "    --distance <path>  save the distance to the closest seed as a PFM file, edt engine only\n");
+    fprintf(stderr, "    --edits <n>        random seed inserts and deletes after the first render, dynamic engine only\n");
+    fprintf(stderr, "    --lloyd <n>        move the seeds to the centroids of their cells up to n times before rendering\n");
+    fprintf(stderr, "    --stats <path>     save the area, perimeter and bounding box of every cell as CSV\n");
+    fprintf(stderr, "    --adjacency <path> save the pairs of neighbouring cells and their shared boundary as CSV\n");
+    fprintf(stderr, "    --band-height <n>  render and save n rows at a time with the fortune engine,\n");
+    fprintf(stderr, "                       for canvases that do not fit into memory\n");
+}
+
+char *shift_flag_value(int argc, char **argv, int *i)
+{
+    if (*i + 1 >= argc) {
+        usage(argv[0]);
+        fprintf(stderr, "ERROR: no value provided for flag `%s`\n", argv[*i]);
+        exit(1);
+    }
+    *i += 1;
+    return argv[*i];
+}
+
+long long parse_flag_number(char **argv, int i, long long min, long long max)
+{
+    char *end = NULL;
+    errno = 0;
+    long long n = strtoll(argv[i], &end, 10);
+    if (*argv[i] == '\0' || *end != '\0' || errno != 0 || n < min || n > max) {
+        usage(argv[0]);
+        fprintf(stderr, "ERROR: `%s` is not a valid value for flag `%s`, expected a number in [%lld, %lld]\n",
+                argv[i], argv[i - 1], min, max);
+        exit(1);
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    Engine engine = ENGINE_INTERESTING;
+    bool compare = false;
+    size_t threads_count = 1;
+    const char *simd_name = NULL;
+    const char *output_file_paths[MAX_OUTPUTS];
+    size_t outputs_count = 0;
+    const char *vector_file_paths[MAX_OUTPUTS];
+    size_t vector_outputs_count = 0;
+    int band_height = 0;
+    const char *distance_file_path = NULL;
+    size_t edits_count = 0;
+    size_t lloyd_iterations = 0;
+    const char *stats_file_path = NULL;
+    const char *adjacency_file_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--engine") == 0) {
+            const char *name = shift_flag_value(argc, argv, &i);
+            engine = COUNT_ENGINES;
+            for (size_t j = 0; j < COUNT_ENGINES; ++j) {
+                if (strcmp(name, engine_names[j]) == 0) {
+                    engine = j;
+                    break;
+                }
+            }
+            if (engine == COUNT_ENGINES) {
+                usage(argv[0]);
+                fprintf(stderr, "ERROR: unknown engine `%s`\n", name);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            compare = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            shift_flag_value(argc, argv, &i);
+            threads_count = parse_flag_number(argv, i, 0, MAX_THREADS);
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            simd_name = shift_flag_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--metric") == 0) {
+            const char *name = shift_flag_value(argc, argv, &i);
+            metric = COUNT_METRICS;
+            for (size_t j = 0; j < COUNT_METRICS; ++j) {
+                if (strcmp(name, metric_names[j]) == 0) {
+                    metric = j;
+                    break;
+                }
+            }
+            if (metric == COUNT_METRICS) {
+                usage(argv[0]);
+                fprintf(stderr, "ERROR: unknown metric `%s`\n", name);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-weight") == 0) {
+            shift_flag_value(argc, argv, &i);
+            max_weight = parse_flag_number(argv, i, 0, MAX_WEIGHT);
+        } else if (strcmp(argv[i], "--width") == 0) {
+            shift_flag_value(argc, argv, &i);
+            canvas_width = parse_flag_number(argv, i, 1, MAX_CANVAS_SIZE);
+        } else if (strcmp(argv[i], "--height") == 0) {
+            shift_flag_value(argc, argv, &i);
+            canvas_height = parse_flag_number(argv, i, 1, MAX_CANVAS_SIZE);
+        } else if (strcmp(argv[i], "--seeds") == 0) {
+            shift_flag_value(argc, argv, &i);
+            seeds_count = parse_flag_number(argv, i, 1, MAX_SEEDS_COUNT);
+        } else if (strcmp(argv[i], "--output") == 0) {
+            const char *path = shift_flag_value(argc, argv, &i);
+            if (outputs_count + vector_outputs_count >= MAX_OUTPUTS) {
+                fprintf(stderr, "ERROR: too many outputs, at most %d are supported\n", MAX_OUTPUTS);
+                exit(1);
+            }
+            if (vector_format_by_path(path) != VECTOR_FORMAT_NONE) {
+                vector_file_paths[vector_outputs_count++] = path;
+            } else {
+                output_file_paths[outputs_count++] = path;
+            }
+        } else if (strcmp(argv[i], "--distance") == 0) {
+            distance_file_path = shift_flag_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--edits") == 0) {
+            shift_flag_value(argc, argv, &i);
+            edits_count = parse_flag_number(argv, i, 0, MAX_SEEDS_COUNT);
+        } else if (strcmp(argv[i], "--lloyd") == 0) {
+            shift_flag_value(argc, argv, &i);
+            lloyd_iterations = parse_flag_number(argv, i, 0, INT_MAX);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_file_path = shift_flag_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--adjacency") == 0) {
+            adjacency_file_path = shift_flag_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--band-height") == 0) {
+            shift_flag_value(argc, argv, &i);
+            band_height = parse_flag_number(argv, i, 1, MAX_CANVAS_SIZE);
+        } else {
+            usage(argv[0]);
+            fprintf(stderr, "ERROR: unknown flag `%s`\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    pool_init(threads_count);
+    simd_select_kernel(simd_name);
+    printf("INFO: using %s kernel\n", simd_kernel->name);
+
+    if (band_height > 0) {
+        if (engine != ENGINE_FORTUNE || compare || stats_file_path != NULL || adjacency_file_path != NULL) {
+            fprintf(stderr, "ERROR: --band-height only works with the fortune engine and without --compare, --stats and --adjacency\n");
+            exit(1);
+        }
+        if (band_height > canvas_height) band_height = canvas_height;
+        labels_rows = band_height;
+    } else {
+        labels_rows = canvas_height;
+    }
+    if (outputs_count + vector_outputs_count == 0) output_file_paths[outputs_count++] = OUTPUT_FILE_PATH;
+    if (distance_file_path != NULL) {
+        if (engine != ENGINE_EDT) {
+            fprintf(stderr, "ERROR: --distance only works with the edt engine\n");
+            exit(1);
+        }
+        edt_export_distances = true;
+    }
+    if (!engine_supports_metric(engine, metric)) {
+        fprintf(stderr, "ERROR: the %s engine does not support the %s metric\n", engine_names[engine], metric_names[metric]);
+        exit(1);
+    }
+    // The cell polygons rely on Euclidean geometry
+    if (metric != METRIC_EUCLIDEAN && (lloyd_iterations > 0 || vector_outputs_count > 0)) {
+        fprintf(stderr, "ERROR: --lloyd, .svg and .geojson outputs only work with the euclidean metric\n");
+        exit(1);
+    }
+    if (edits_count > 0 && engine != ENGINE_DYNAMIC) {
+        fprintf(stderr, "ERROR: --edits only works with the dynamic engine\n");
+        exit(1);
+    }
+    if (edits_count > 0 && vector_outputs_count > 0) {
+        fprintf(stderr, "ERROR: .svg and .geojson outputs do not support --edits\n");
+        exit(1);
+    }
+    // Every edit may be an insert
+    if (edits_count > MAX_SEEDS_COUNT - seeds_count) {
+        fprintf(stderr, "ERROR: %zu seeds plus %zu edits do not fit into %d-bit labels\n", seeds_count, edits_count, LABEL_BITS);
+        exit(1);
+    }
+    seeds_capacity = seeds_count + edits_count;
+
+    arena_reserve(&arena, arena_capacity_needed(labels_rows, pool.threads_count));
+    labels = arena_alloc(&arena, (size_t)canvas_width*labels_rows*sizeof(*labels));
+    image = arena_alloc(&arena, (size_t)canvas_width*image_rows_capacity()*sizeof(*image));
+    seeds = arena_alloc(&arena, seeds_capacity*sizeof(*seeds));
+    seed_weights = arena_alloc(&arena, seeds_capacity*sizeof(*seed_weights));
+    memset(seed_weights, 0, seeds_capacity*sizeof(*seed_weights));
+    markers_order = arena_alloc(&arena, seeds_capacity*sizeof(*markers_order));
+    arena_render_mark = arena.size;
+
+    srand(time(0));
+    generate_random_seeds();
+    if (metric == METRIC_POWER || metric == METRIC_ADDITIVE) generate_random_weights();
+    if (lloyd_iterations > 0) {
+        double start = get_secs();
+        lloyd_relax(lloyd_iterations);
+        printf("INFO: lloyd relaxation took %.3fs\n", get_secs() - start);
+    }
+    sort_seed_markers();
+
+    double start;
+    if (band_height > 0) {
+        if (outputs_count > 0) {
+            start = get_secs();
+            render_voronoi_in_bands(output_file_paths, outputs_count, band_height);
+            printf("INFO: rendering and saving in bands took %.3fs\n", get_secs() - start);
+        }
+        save_vector_outputs(vector_file_paths, vector_outputs_count);
+        return 0;
+    }
+
+    // Vector outputs alone do not need a single pixel
+    bool rasterize = outputs_count > 0 || compare || stats_file_path != NULL || adjacency_file_path != NULL
+        || distance_file_path != NULL || edits_count > 0;
+    if (rasterize) {
+        clear_labels();
+        start = get_secs();
+        render_voronoi(engine);
+        printf("INFO: %s engine took %.3fs\n", engine_names[engine], get_secs() - start);
+    }
+
+    if (edits_count > 0) {
+        dynamic_random_edits(edits_count);
+    }
+
+    if (compare) {
+        size_t count = engine == ENGINE_DYNAMIC ? dynamic_count_pixels_differing_from_naive() : count_pixels_differing_from_naive();
+        printf("INFO: %zu/%zu pixels differ from the naive engine\n", count, pixels_count());
+    }
+
+    if (stats_file_path != NULL || adjacency_file_path != NULL) {
+        start = get_secs();
+        compute_cell_stats();
+        printf("INFO: cell statistics took %.3fs, %zu pairs of cells are neighbours\n",
+               get_secs() - start, cell_adjacency.count);
+        if (stats_file_path != NULL) save_cell_stats(stats_file_path);
+        if (adjacency_file_path != NULL) save_cell_adjacency(adjacency_file_path);
+    }
+
+    if (outputs_count > 0) {
+        start = get_secs();
+        save_images(output_file_paths, outputs_count);
+        printf("INFO: resolving and saving %zu file(s) took %.3fs\n", outputs_count, get_secs() - start);
+    }
+    if (distance_file_path != NULL) {
+        start = get_secs();
+        save_distance_field(distance_file_path);
+        printf("INFO: saving %s took %.3fs\n", distance_file_path, get_secs() - start);
+    }
+    save_vector_outputs(vector_file_paths, vector_outputs_count);
+    dynamic_grid_free();
+    printf("INFO: peak RSS %zu KB\n", peak_rss_kb());
     return 0;
 }
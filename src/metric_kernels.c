@@ -0,0 +1,211 @@
+// Kernels specialized for one distance metric. main_ppm.c includes this file
+// once per metric with the following macros defined, and they are undefined
+// again at the end:
+//
+//   METRIC_NAME                  suffix of the generated functions
+//   METRIC_ROW(dy, w)            share of the vertical distance dy of a seed of
+//                                weight w, computed once per row
+//   METRIC_BIAS(w)               share of the weight w that can not be folded
+//                                into the row, computed once per seed
+//   METRIC_DEPTH(dx, row, bias)  depth of the pixel dx away horizontally
+//   METRIC_DEPTH_SSE41(dx, row, bias), METRIC_DEPTH_AVX2(dx, row, bias),
+//   METRIC_DEPTH_AVX512(dx, row, bias)
+//                                the same on vectors of 32-bit lanes
+//
+// A depth only has to order the pixels the same way the distance does, so
+// Euclidean skips the square root and Minkowski the p-th root. Depths grow
+// with |dx| and |dy| and shrink with the weight. The metric is picked once
+// per render, the inner loops never look at it.
+
+#define METRIC_CONCAT_(name, metric) name##_##metric
+#define METRIC_CONCAT(name, metric) METRIC_CONCAT_(name, metric)
+#define METRIC_FN(name) METRIC_CONCAT(name, METRIC_NAME)
+
+int64_t METRIC_FN(seed_depth)(size_t i, int x, int y)
+{
+    int64_t dx = x - seeds[i].x;
+    int64_t dy = y - seeds[i].y;
+    int w = seed_weights[i];
+    (void) w;
+    return METRIC_DEPTH(dx, METRIC_ROW(dy, w), METRIC_BIAS(w));
+}
+
+void METRIC_FN(render_voronoi_naive)(void)
+{
+    for (int y = 0; y < canvas_height; ++y) {
+        for (int x = 0; x < canvas_width; ++x) {
+            int j = 0;
+            int64_t best = METRIC_FN(seed_depth)(0, x, y);
+            for (size_t i = 1; i < seeds_count; ++i) {
+                int64_t d = METRIC_FN(seed_depth)(i, x, y);
+                if (d < best) {
+                    best = d;
+                    j = i;
+                }
+            }
+            labels[(size_t)y*canvas_width + x] = j;
+        }
+    }
+}
+
+static inline void METRIC_FN(seed_grid_scan_cell)(int gx, int gy, int x, int y, uint32_t *best, int64_t *best_dist)
+{
+    if (gx < 0 || gx >= grid_cols || gy < 0 || gy >= grid_rows) return;
+    size_t cell = (size_t)gy*grid_cols + gx;
+    for (uint32_t k = grid_cells[cell]; k < grid_cells[cell + 1]; ++k) {
+        uint32_t i = grid_seeds[k];
+        int64_t d = METRIC_FN(seed_depth)(i, x, y);
+        if (d < *best_dist || (d == *best_dist && i < *best)) {
+            *best = i;
+            *best_dist = d;
+        }
+    }
+}
+
+// Same answer as the linear scan in render_voronoi_naive(), including the
+// smallest index winning ties, but only looking at the rings of cells around
+// (x, y) that can still contain something closer than the best seed so far.
+uint32_t METRIC_FN(seed_grid_nearest)(int x, int y)
+{
+    int cx = x/grid_cell_size;
+    int cy = y/grid_cell_size;
+    uint32_t best = UINT32_MAX;
+    int64_t best_dist = INT64_MAX;
+
+    int max_ring = grid_cols > grid_rows ? grid_cols : grid_rows;
+    for (int r = 0; r < max_ring; ++r) {
+        if (r == 0) {
+            METRIC_FN(seed_grid_scan_cell)(cx, cy, x, y, &best, &best_dist);
+        } else {
+            for (int gx = cx - r; gx <= cx + r; ++gx) {
+                METRIC_FN(seed_grid_scan_cell)(gx, cy - r, x, y, &best, &best_dist);
+                METRIC_FN(seed_grid_scan_cell)(gx, cy + r, x, y, &best, &best_dist);
+            }
+            for (int gy = cy - r + 1; gy < cy + r; ++gy) {
+                METRIC_FN(seed_grid_scan_cell)(cx - r, gy, x, y, &best, &best_dist);
+                METRIC_FN(seed_grid_scan_cell)(cx + r, gy, x, y, &best, &best_dist);
+            }
+        }
+
+        // Anything we have not looked at yet is at least this far away along
+        // one of the axes, and at best has the largest weight
+        int64_t reach = x - (int64_t)(cx - r)*grid_cell_size;
+        int64_t right = (int64_t)(cx + r + 1)*grid_cell_size - x;
+        int64_t top = y - (int64_t)(cy - r)*grid_cell_size;
+        int64_t bottom = (int64_t)(cy + r + 1)*grid_cell_size - y;
+        if (right < reach) reach = right;
+        if (top < reach) reach = top;
+        if (bottom < reach) reach = bottom;
+        int64_t bound = METRIC_DEPTH(reach, METRIC_ROW((int64_t)0, max_weight), METRIC_BIAS(max_weight));
+        if (best != UINT32_MAX && bound > best_dist) break;
+    }
+
+    return best;
+}
+
+void METRIC_FN(render_voronoi_grid)(void)
+{
+    for (int y = 0; y < canvas_height; ++y) {
+        for (int x = 0; x < canvas_width; ++x) {
+            labels[(size_t)y*canvas_width + x] = METRIC_FN(seed_grid_nearest)(x, y);
+        }
+    }
+}
+
+void METRIC_FN(apply_seed_row_scalar)(int *depth_row, Label *label_row, int count, int dx0, int dy, int weight, Label label)
+{
+    // Not every metric looks at the weight
+    (void) weight;
+    int row = METRIC_ROW(dy, weight);
+    int bias = METRIC_BIAS(weight);
+    (void) bias;
+    for (int i = 0; i < count; ++i) {
+        int dx = dx0 + i;
+        int d = METRIC_DEPTH(dx, row, bias);
+        if (d < depth_row[i]) {
+            depth_row[i] = d;
+            label_row[i] = label;
+        }
+    }
+}
+
+// The vector kernels blend 32-bit lanes of depth and labels together, so
+// 16-bit labels stay on the scalar one
+#if defined(SIMD_X86) && LABEL_BITS == 32
+__attribute__((target("sse4.1")))
+void METRIC_FN(apply_seed_row_sse41)(int *depth_row, Label *label_row, int count, int dx0, int dy, int weight, Label label)
+{
+    __m128i dx = _mm_add_epi32(_mm_set1_epi32(dx0), _mm_setr_epi32(0, 1, 2, 3));
+    __m128i row = _mm_set1_epi32(METRIC_ROW(dy, weight));
+    __m128i bias = _mm_set1_epi32(METRIC_BIAS(weight));
+    (void) bias;
+    __m128i vlabel = _mm_set1_epi32(label);
+    __m128i step = _mm_set1_epi32(4);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = METRIC_DEPTH_SSE41(dx, row, bias);
+        __m128i old_depth = _mm_loadu_si128((__m128i*)&depth_row[i]);
+        __m128i old_label = _mm_loadu_si128((__m128i*)&label_row[i]);
+        __m128i mask = _mm_cmplt_epi32(d, old_depth);
+        _mm_storeu_si128((__m128i*)&depth_row[i], _mm_blendv_epi8(old_depth, d, mask));
+        _mm_storeu_si128((__m128i*)&label_row[i], _mm_blendv_epi8(old_label, vlabel, mask));
+        dx = _mm_add_epi32(dx, step);
+    }
+    METRIC_FN(apply_seed_row_scalar)(&depth_row[i], &label_row[i], count - i, dx0 + i, dy, weight, label);
+}
+
+__attribute__((target("avx2")))
+void METRIC_FN(apply_seed_row_avx2)(int *depth_row, Label *label_row, int count, int dx0, int dy, int weight, Label label)
+{
+    __m256i dx = _mm256_add_epi32(_mm256_set1_epi32(dx0), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i row = _mm256_set1_epi32(METRIC_ROW(dy, weight));
+    __m256i bias = _mm256_set1_epi32(METRIC_BIAS(weight));
+    (void) bias;
+    __m256i vlabel = _mm256_set1_epi32(label);
+    __m256i step = _mm256_set1_epi32(8);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i d = METRIC_DEPTH_AVX2(dx, row, bias);
+        __m256i old_depth = _mm256_loadu_si256((__m256i*)&depth_row[i]);
+        __m256i old_label = _mm256_loadu_si256((__m256i*)&label_row[i]);
+        __m256i mask = _mm256_cmpgt_epi32(old_depth, d);
+        _mm256_storeu_si256((__m256i*)&depth_row[i], _mm256_blendv_epi8(old_depth, d, mask));
+        _mm256_storeu_si256((__m256i*)&label_row[i], _mm256_blendv_epi8(old_label, vlabel, mask));
+        dx = _mm256_add_epi32(dx, step);
+    }
+    METRIC_FN(apply_seed_row_scalar)(&depth_row[i], &label_row[i], count - i, dx0 + i, dy, weight, label);
+}
+
+__attribute__((target("avx512f")))
+void METRIC_FN(apply_seed_row_avx512)(int *depth_row, Label *label_row, int count, int dx0, int dy, int weight, Label label)
+{
+    __m512i dx = _mm512_add_epi32(_mm512_set1_epi32(dx0), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    __m512i row = _mm512_set1_epi32(METRIC_ROW(dy, weight));
+    __m512i bias = _mm512_set1_epi32(METRIC_BIAS(weight));
+    (void) weight;
+    (void) bias;
+    __m512i vlabel = _mm512_set1_epi32(label);
+    __m512i step = _mm512_set1_epi32(16);
+    for (int i = 0; i < count; i += 16) {
+        // Masked loads and stores take care of the tail
+        __mmask16 in_row = count - i >= 16 ? 0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+        __m512i d = METRIC_DEPTH_AVX512(dx, row, bias);
+        __m512i old_depth = _mm512_maskz_loadu_epi32(in_row, &depth_row[i]);
+        __mmask16 mask = _mm512_mask_cmplt_epi32_mask(in_row, d, old_depth);
+        _mm512_mask_storeu_epi32(&depth_row[i], mask, d);
+        _mm512_mask_storeu_epi32(&label_row[i], mask, vlabel);
+        dx = _mm512_add_epi32(dx, step);
+    }
+}
+#endif // SIMD_X86 && LABEL_BITS == 32
+
+#undef METRIC_FN
+#undef METRIC_CONCAT
+#undef METRIC_CONCAT_
+#undef METRIC_NAME
+#undef METRIC_ROW
+#undef METRIC_BIAS
+#undef METRIC_DEPTH
+#undef METRIC_DEPTH_SSE41
+#undef METRIC_DEPTH_AVX2
+#undef METRIC_DEPTH_AVX512